@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bytecode.hpp"
+#include "interpreter.hpp"
+#include "jit.hpp"
+#include "lexer.hpp"
+#include "optimizer.hpp"
+#include "parser.hpp"
+
+/**
+ * @brief Runs many scripts at once, an engine each, and checks that every one ends the way
+ * it does when run alone. Prints the throughput for each amount of threads.
+ *
+ * Build with -fsanitize=thread to check that engines share nothing they write to.
+ */
+
+/// A script, and how it ends when run alone.
+struct script
+{
+	std::string source;
+	std::string expected;
+};
+
+/// Write out every variable and the error that stopped the script, if any. Variables are sorted by
+/// name, since bytecode gives them slots in another order.
+std::string describe(const interpreter::env& state, const std::string& error)
+{
+	std::vector<std::string> variables;
+	for (interpreter::slot var = 0; var < state.size(); ++var)
+	{
+		std::string line(symbol::text(state.name(var)));
+		if (state.assigned(var))
+		{
+			line += ": " + state.value(var).type() + " = " + state.value(var).value();
+		}
+		variables.push_back(line);
+	}
+	std::sort(variables.begin(), variables.end());
+
+	std::ostringstream ss;
+	for (const std::string& line : variables)
+	{
+		ss << line << "\n";
+	}
+	ss << error;
+	return ss.str();
+}
+
+/// Make a script of assignments. Some read variables before they're defined, which throws.
+std::string generate(std::mt19937& rng, size_t lines)
+{
+	const char* literals[] = { "1", "25", "007", "\"short\"", "\"a string too long to store inline\"" };
+	auto name			   = [&] { return "v" + std::to_string(rng() % 24); };
+	auto atom			   = [&] { return rng() % 2 ? name() : literals[rng() % 5]; };
+
+	std::string source;
+	for (size_t line = 0; line < lines; ++line)
+	{
+		source += name() + " = ";
+		switch (rng() % 4)
+		{
+		case 0:
+			source += literals[rng() % 5];
+			break;
+		case 1:
+			source += rng() % 64 == 0 ? "undefined" : name();
+			break;
+		default:
+			source += "(" + atom() + " " + "+-*/"[rng() % 4] + " (" + atom() + " + " + atom() + "))";
+		}
+		source += "\n";
+	}
+	return source;
+}
+
+/// Lex, parse and run a script in a new engine, in one of the ways a script can be run.
+std::string run(const std::string& source, size_t way)
+{
+	std::vector<lexer::token> tokens = lexer::lex(source);
+	parser::options opts;
+	opts.hash_cons = way & 1;
+	ast::tree code = parser::parse(tokens, opts);
+	if (way & 2)
+	{
+		code = optimizer::optimize(code);
+	}
+
+	interpreter::engine engine;
+	std::string error;
+	try
+	{
+		switch (way >> 2)
+		{
+		case 0:
+			engine.interpret(code);
+			break;
+		case 1:
+			bytecode::run(bytecode::compile(code), engine.state());
+			break;
+		default:
+			jit::run(jit::compile(code, engine), code, engine);
+		}
+	}
+	catch (std::runtime_error& e)
+	{
+		error = e.what();
+	}
+	return describe(engine.state(), error);
+}
+
+/// The ways a script can be run: plain or hash-consed, optimized or not, and each way of executing it.
+constexpr size_t ways = 12;
+
+int main(int argc, char** argv)
+{
+	std::mt19937 rng(1);
+	std::vector<script> scripts(64);
+	for (script& s : scripts)
+	{
+		s.source   = generate(rng, 200 + rng() % 800);
+		s.expected = run(s.source, 0);
+	}
+
+	size_t cores	   = std::max(std::thread::hardware_concurrency(), 1u);
+	size_t max_threads = argc > 1 ? std::stoul(argv[1]) : std::max<size_t>(cores, 8);
+	size_t per_thread  = argc > 2 ? std::stoul(argv[2]) : 96;
+	printf("%zu scripts, %zu cores\n", scripts.size(), cores);
+	printf("%-8s%14s\n", "threads", "scripts/s");
+
+	bool failed = false;
+	for (size_t threads = 1; threads <= max_threads; threads *= 2)
+	{
+		std::atomic<size_t> mismatches{ 0 };
+		std::vector<std::thread> workers;
+		auto begin = std::chrono::steady_clock::now();
+		for (size_t t = 0; t < threads; ++t)
+		{
+			workers.emplace_back([&, t] {
+				// Every thread runs every script every way, starting at different places.
+				for (size_t i = 0; i < per_thread; ++i)
+				{
+					size_t n		= t * 7 + i;
+					const script& s = scripts[n % scripts.size()];
+					if (run(s.source, n % ways) != s.expected)
+					{
+						++mismatches;
+					}
+				}
+			});
+		}
+		for (std::thread& worker : workers)
+		{
+			worker.join();
+		}
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+		printf("%-8zu%14.1f", threads, threads * per_thread / elapsed.count());
+		if (mismatches != 0)
+		{
+			printf("  %zu runs ended differently than when run alone", mismatches.load());
+			failed = true;
+		}
+		printf("\n");
+	}
+
+	return failed ? 1 : 0;
+}
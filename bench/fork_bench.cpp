@@ -0,0 +1,102 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "interpreter.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+
+/**
+ * @brief Benchmarks running many variants of a script that share a long prefix, by running the
+ * prefix every time, and by forking a snapshot of the state after it. Prints the time and the
+ * memory each variant's state costs, with every variant's state kept alive at once.
+ */
+
+/// Parse a script, keeping the text it views alive alongside it.
+struct parsed
+{
+	std::string text;
+	std::vector<lexer::token> tokens;
+	ast::tree tree;
+
+	explicit parsed(std::string script)
+		: text(std::move(script)), tokens(lexer::lex(text)), tree(parser::parse(tokens))
+	{
+	}
+};
+
+double seconds_since(std::chrono::steady_clock::time_point begin)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+int main()
+{
+	const size_t variables		   = 1 << 14;
+	const size_t prefix_statements = 1 << 17;
+	const size_t variants		   = 256;
+
+	std::string prefix_text;
+	for (size_t i = 0; i < prefix_statements; ++i)
+	{
+		prefix_text += "v" + std::to_string(i % variables) + " = " + std::to_string(i) + "\n";
+	}
+	parsed prefix(prefix_text);
+
+	printf("%zu variables, a prefix of %zu statements, %zu variants\n", variables, prefix_statements, variants);
+	printf("%-10s%18s%18s%18s%18s\n", "changed", "rerun ms", "fork ms", "rerun KB/variant", "fork KB/variant");
+	for (size_t changed : { 1, 16, 256, 4096 })
+	{
+		// Each variant changes a few variables, spread out over the state, and adds one of its own.
+		std::vector<parsed> suffixes;
+		for (size_t v = 0; v < variants; ++v)
+		{
+			std::string text;
+			for (size_t i = 0; i < changed; ++i)
+			{
+				text += "v" + std::to_string((v * 7919 + i * 104729) % variables) + " = " + std::to_string(v) + "\n";
+			}
+			text += "variant = " + std::to_string(v) + "\n";
+			suffixes.emplace_back(std::move(text));
+		}
+
+		std::vector<interpreter::engine> rerun(variants);
+		auto begin = std::chrono::steady_clock::now();
+		for (size_t v = 0; v < variants; ++v)
+		{
+			rerun[v].interpret(prefix.tree);
+			rerun[v].interpret(suffixes[v].tree);
+		}
+		double rerun_time  = seconds_since(begin);
+		size_t rerun_bytes = 0;
+		for (interpreter::engine& engine : rerun)
+		{
+			rerun_bytes += engine.state().unshared_bytes();
+		}
+		rerun.clear();
+
+		// The snapshot's taken once, and isn't counted against the variants.
+		interpreter::engine base;
+		base.interpret(prefix.tree);
+		interpreter::snapshot start(base.state());
+
+		std::vector<interpreter::engine> forked;
+		forked.reserve(variants);
+		begin = std::chrono::steady_clock::now();
+		for (size_t v = 0; v < variants; ++v)
+		{
+			forked.emplace_back(start);
+			forked[v].interpret(suffixes[v].tree);
+		}
+		double fork_time  = seconds_since(begin);
+		size_t fork_bytes = 0;
+		for (interpreter::engine& engine : forked)
+		{
+			fork_bytes += engine.state().unshared_bytes();
+		}
+
+		printf("%-10zu%18.1f%18.1f%18.1f%18.1f\n", changed, rerun_time * 1e3, fork_time * 1e3,
+			   rerun_bytes / 1024.0 / variants, fork_bytes / 1024.0 / variants);
+	}
+	return 0;
+}
@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include "bytecode.hpp"
+#include "interpreter.hpp"
+#include "jit.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+
+/**
+ * @brief Benchmarks running a parsed program, printing the throughput of each way of running it.
+ * 
+ */
+
+/// Get the best of a few runs' throughput, in millions of statements per second. Each run gets a new engine.
+double throughput(size_t statements, std::function<void(interpreter::engine&)> run)
+{
+	double best = 0;
+	for (int i = 0; i < 5; ++i)
+	{
+		interpreter::engine engine;
+		auto begin = std::chrono::steady_clock::now();
+		run(engine);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+		best = std::max(best, statements / elapsed.count() / 1e6);
+	}
+	return best;
+}
+
+int main()
+{
+	const size_t statements = 1 << 20;
+
+	struct workload
+	{
+		const char* name;
+		const char* statements[4];
+	};
+	workload workloads[] = {
+		{ "literals", { "count = 12345", "name = \"hello\"", "total = 6", "flag = 1" } },
+		{ "copies", { "a = 1", "b = a", "c = b", "a = c" } },
+		{ "arithmetic", { "a = 1", "b = (a + 2) ", "c = (a * (b - 3))", "d = ((a + b) / (c + 4))" } },
+	};
+
+	printf("%-12s%14s%14s%14s%14s%14s\n", "Mstmt/s", "tree-walker", "bytecode", "compile+run", "jit", "jit+compile");
+	for (auto& w : workloads)
+	{
+		std::string script;
+		for (size_t i = 0; i < statements; ++i)
+		{
+			script += w.statements[i % 4];
+			script += '\n';
+		}
+		std::vector<lexer::token> tokens = lexer::lex(script);
+		ast::tree tree					 = parser::parse(tokens);
+		bytecode::program compiled		 = bytecode::compile(tree);
+		// Native code's tied to the slots the variables were given, which every new engine gives them too.
+		interpreter::engine compiling;
+		jit::program native = jit::compile(tree, compiling);
+
+		printf("%-12s", w.name);
+		printf("%14.1f", throughput(statements, [&](interpreter::engine& e) { e.interpret(tree); }));
+		printf("%14.1f", throughput(statements, [&](interpreter::engine& e) { bytecode::run(compiled, e.state()); }));
+		printf("%14.1f", throughput(statements, [&](interpreter::engine& e) { bytecode::run(bytecode::compile(tree), e.state()); }));
+		printf("%14.1f", throughput(statements, [&](interpreter::engine& e) { jit::run(native, tree, e); }));
+		printf("%14.1f", throughput(statements, [&](interpreter::engine& e) { jit::run(jit::compile(tree, e), tree, e); }));
+		printf("\n");
+	}
+
+	return 0;
+}
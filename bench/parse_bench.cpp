@@ -0,0 +1,56 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include "lexer.hpp"
+#include "parser.hpp"
+
+/**
+ * @brief Benchmarks the Pratt parser, printing its throughput for each amount of jobs.
+ * 
+ */
+
+/// Get the best of a few runs' throughput of parsing the tokens, in millions of tokens per second.
+double throughput(const std::vector<lexer::token>& tokens, const parser::options& opts)
+{
+	double best = 0;
+	for (int run = 0; run < 3; ++run)
+	{
+		auto begin  = std::chrono::steady_clock::now();
+		ast::tree tree = parser::parse(tokens, opts);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+		best = std::max(best, tokens.size() / elapsed.count() / 1e6);
+	}
+	return best;
+}
+
+int main(int argc, char** argv)
+{
+	std::string script;
+	while (script.size() < (32 << 20))
+	{
+		script += "value = (count + 12345) * (total - 6) / 7\nmessage = \"hello, world\"\n\n";
+	}
+	std::vector<lexer::token> tokens = lexer::lex(script);
+
+	// Up to as many jobs as there are cores, unless told otherwise.
+	size_t cores	= std::max(std::thread::hardware_concurrency(), 1u);
+	size_t max_jobs = argc > 1 ? std::stoul(argv[1]) : cores;
+	printf("%zu tokens, %zu cores\n", tokens.size(), cores);
+	printf("%-8s%12s%12s\n", "Mtok/s", "plain", "hash-cons");
+	for (size_t jobs = 1; jobs <= max_jobs; jobs *= 2)
+	{
+		parser::options opts;
+		opts.jobs = jobs;
+		printf("%-8zu", jobs);
+		for (bool hash_cons : { false, true })
+		{
+			opts.hash_cons = hash_cons;
+			printf("%12.1f", throughput(tokens, opts));
+		}
+		printf("\n");
+	}
+
+	return 0;
+}
@@ -0,0 +1,100 @@
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+#include "lexer.hpp"
+#include "scan.hpp"
+
+/**
+ * @brief Benchmarks the lexer's scanning kernels, printing the throughput of each implementation.
+ * 
+ */
+
+/// Build a buffer of runs of the given characters, of random lengths, each ended by the stop character.
+std::string make_runs(size_t size, const std::string& chars, char stop, size_t max_run)
+{
+	std::mt19937 rng(1);
+	std::string ret;
+	ret.reserve(size);
+	while (ret.size() < size)
+	{
+		size_t run = 1 + rng() % max_run;
+		for (size_t i = 0; i < run; ++i)
+		{
+			ret += chars[rng() % chars.size()];
+		}
+		ret += stop;
+	}
+	return ret;
+}
+
+/// Get the throughput of calling the scanner over the whole buffer, in MB/s.
+double throughput(const std::string& buf, std::function<size_t(std::string_view, size_t)> scanner)
+{
+	auto begin = std::chrono::steady_clock::now();
+	for (size_t pos = 0; pos < buf.size();)
+	{
+		// Step over the character that ended the last run.
+		pos = scanner(buf, pos) + 1;
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+	return buf.size() / elapsed.count() / 1e6;
+}
+
+int main()
+{
+	const size_t size = 64 << 20;
+
+	struct kernel
+	{
+		const char* name;
+		std::string buf;
+		std::function<size_t(std::string_view, size_t)> scanner;
+	};
+	kernel kernels[] = {
+		{ "skip_blank", make_runs(size, " \t", 'x', 64), scan::skip_blank },
+		{ "skip_alnum", make_runs(size, "abcXYZ019", ' ', 32), scan::skip_alnum },
+		{ "skip_digits", make_runs(size, "0123456789", ' ', 16), scan::skip_digits },
+		{ "find_line_end", make_runs(size, "abc \"= 1", '\n', 120), [](std::string_view code, size_t pos) {
+			 return scan::find_line_end(code, pos, true);
+		 } },
+	};
+
+	std::string script;
+	while (script.size() < size)
+	{
+		script += "value = (count + 12345);    message = \"hello, world\"\n";
+	}
+
+	printf("%-16s", "MB/s");
+	for (int l = 0; l <= static_cast<int>(scan::best()); ++l)
+	{
+		printf("%12s", scan::name(static_cast<scan::level>(l)));
+	}
+	printf("\n");
+
+	for (auto& k : kernels)
+	{
+		printf("%-16s", k.name);
+		for (int l = 0; l <= static_cast<int>(scan::best()); ++l)
+		{
+			scan::use(static_cast<scan::level>(l));
+			printf("%12.0f", throughput(k.buf, k.scanner));
+		}
+		printf("\n");
+	}
+
+	printf("%-16s", "lexer::lex");
+	for (int l = 0; l <= static_cast<int>(scan::best()); ++l)
+	{
+		scan::use(static_cast<scan::level>(l));
+		auto begin = std::chrono::steady_clock::now();
+		auto tokens = lexer::lex(script);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+		printf("%12.0f", script.size() / elapsed.count() / 1e6);
+	}
+	printf("\n");
+
+	return 0;
+}
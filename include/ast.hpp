@@ -0,0 +1,313 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "lexer.hpp"
+#include "symbol.hpp"
+
+/**
+ * @brief The parsed program, stored flat: nodes live in one array and refer to each other by index.
+ *
+ */
+namespace ast
+{
+
+/// Node kinds. Leaves share the names of the token kinds they were made from.
+enum class kind : uint8_t
+{
+	identifier,
+	number,
+	string,
+	oper,
+	separator,
+	parens,
+	colon,
+	comma,
+	error,
+	entry,
+	arithmetic,
+	assignment,
+	nop,
+	expression
+};
+
+/// The kind's name, as the parser and the interpreter spell it.
+const std::string& name(kind k);
+
+/// The kind with the given name, if there is one.
+std::optional<kind> kind_of(std::string_view name);
+
+/// Whether nodes of the kind have their text interned, instead of stored in the tree.
+constexpr bool interned(kind k)
+{
+	return k == kind::identifier || k == kind::string;
+}
+
+/// The index of a node in its tree.
+using node_id = uint32_t;
+
+/// Refers to no node at all.
+constexpr node_id no_node = std::numeric_limits<node_id>::max();
+
+/// A node, made only of plain integers so that trees can be written out and mapped back in as they are.
+struct node
+{
+	kind type;
+	node_id parent;
+	/// Where the node's children start in the tree's child list.
+	uint32_t first_child;
+	uint32_t child_count;
+	/// Where the node's value is in the tree's text. For interned kinds, the index of its symbol in the tree's symbol list instead.
+	uint32_t text_offset;
+	uint32_t text_length;
+};
+
+/// A node's children, in order.
+class child_range
+{
+public:
+	child_range(const node_id* begin, const node_id* end)
+		: m_begin(begin), m_end(end)
+	{
+	}
+
+	const node_id* begin() const { return m_begin; }
+	const node_id* end() const { return m_end; }
+	size_t size() const { return m_end - m_begin; }
+	node_id operator[](size_t n) const { return m_begin[n]; }
+	/// Bounds checked access.
+	node_id at(size_t n) const
+	{
+		if (n >= size()) throw std::out_of_range("Node has no child " + std::to_string(n) + ".");
+		return m_begin[n];
+	}
+
+private:
+	const node_id* m_begin;
+	const node_id* m_end;
+};
+
+/**
+ * @brief A program tree, allocated in three arrays: nodes, child indices, and the nodes' text.
+ *
+ * Identifiers and strings are interned instead, and the tree only keeps a list of the
+ * symbols its nodes use, which is written out as text so that written trees don't
+ * depend on the process that wrote them.
+ *
+ * If hash-consed, structurally identical subtrees are only stored once, and adding one
+ * again returns the node already there. A shared node's parent is the first one it got.
+ *
+ * A tree can also view those arrays in memory it doesn't own, e.g. a mapped cache file,
+ * in which case it can't be added to.
+ */
+class tree
+{
+public:
+	/// Create an empty tree, optionally hash-consing its nodes.
+	tree(bool hash_cons = false);
+
+	/// Add a leaf for a token.
+	node_id leaf(const lexer::token& tok);
+	/// Add a leaf with the given text.
+	node_id leaf(kind type, std::string_view text);
+
+	/**
+	 * @brief Add a node over nodes already in the tree, which become its children.
+	 *
+	 * @param type The kind of the new node.
+	 * @param children The children, in order. Unless hash-consed, they must not have a parent yet.
+	 * @param text The node's text.
+	 */
+	node_id branch(kind type, const std::vector<node_id>& children, std::string_view text = "");
+	node_id branch(kind type, std::initializer_list<node_id> children, std::string_view text = "");
+
+	/**
+	 * @brief Add every node of another tree, in order. Hash-consed trees share nodes across both.
+	 *
+	 * @return std::vector<node_id> The id each of other's nodes has in this tree.
+	 */
+	std::vector<node_id> append(const tree& other);
+
+	/**
+	 * @brief Join trees that aren't hash-consed end to end, copying each on its own thread.
+	 *
+	 * @return std::pair<tree, std::vector<node_id>> The joined tree, with no root set, and where
+	 * each piece's nodes start in it. Node n of piece i becomes node n + start i.
+	 */
+	static std::pair<tree, std::vector<node_id>> concat(const std::vector<tree>& pieces);
+
+	/// Where the tree's arrays end.
+	struct position
+	{
+		size_t nodes;
+		size_t children;
+		size_t text;
+	};
+
+	/// Where the tree ends now, to rewind to later.
+	position mark() const;
+	/// Drop every node added since the mark was taken. Symbols are kept, since they're shared.
+	void rewind(position mark);
+
+	/// Set the node the program starts from.
+	void set_root(node_id id);
+	node_id root() const;
+
+	// Reading the tree is inline, since walking it calls these for every node.
+
+	const node& operator[](node_id id) const
+	{
+		return data().nodes[id];
+	}
+
+	child_range children(node_id id) const
+	{
+		arrays a	  = data();
+		const node& n = a.nodes[id];
+		return { a.children + n.first_child, a.children + n.first_child + n.child_count };
+	}
+
+	kind type(node_id id) const
+	{
+		return data().nodes[id].type;
+	}
+
+	/// The node's value.
+	std::string_view text(node_id id) const
+	{
+		arrays a	  = data();
+		const node& n = a.nodes[id];
+		if (interned(n.type))
+		{
+			return symbol::text(m_symbols[n.text_offset]);
+		}
+		return std::string_view(a.text + n.text_offset, n.text_length);
+	}
+
+	/// The value of a node whose kind isn't interned, straight from the tree's own text.
+	std::string_view stored_text(node_id id) const
+	{
+		arrays a	  = data();
+		const node& n = a.nodes[id];
+		return std::string_view(a.text + n.text_offset, n.text_length);
+	}
+
+	/// The node's symbol, or symbol::none if its kind isn't interned.
+	symbol::id symbol(node_id id) const
+	{
+		const node& n = data().nodes[id];
+		return interned(n.type) ? m_symbols[n.text_offset] : symbol::none;
+	}
+
+	std::string value(node_id id) const;
+
+	/// A hash of the node's whole subtree. Cached if hash-consed, otherwise computed on demand.
+	uint64_t hash(node_id id) const;
+	/// Whether two subtrees are structurally equal. Just compares ids if hash-consed.
+	bool equal(node_id a, node_id b) const;
+
+	/// The amount of nodes in the tree.
+	size_t size() const
+	{
+		return data().node_count;
+	}
+	/// The amount of nodes the tree would have if no subtree were shared.
+	size_t expanded_size() const;
+	bool hash_consed() const;
+
+	/// Convert to a printable string.
+	std::string str() const;
+
+	/**
+	 * @brief Write the tree out, in the layout `view` reads.
+	 *
+	 * @remarks Where it's written to must be 8-byte aligned, for the arrays to be aligned when viewed.
+	 */
+	void write(std::ostream& out) const;
+
+	/**
+	 * @brief View a tree written by `write`, without copying it.
+	 *
+	 * @param owner Keeps the memory data views alive for as long as the tree is.
+	 * @param data The written tree, 8-byte aligned.
+	 * @return std::optional<tree> The tree, or nothing if data isn't a valid tree.
+	 */
+	static std::optional<tree> view(std::shared_ptr<const void> owner, std::string_view data);
+
+private:
+	template <typename It>
+	node_id add_branch(kind type, It begin, It end, std::string_view text);
+
+	/// Hash a node that's about to be added.
+	template <typename It>
+	uint64_t hash_of(kind type, std::string_view text, It begin, It end) const;
+	/// Find a node equal to the one about to be added, or no_node.
+	template <typename It>
+	node_id find(uint64_t hash, kind type, std::string_view text, uint32_t local, It begin, It end) const;
+	template <typename It>
+	node_id insert(uint64_t hash, kind type, std::string_view text, uint32_t local, It begin, It end);
+
+	/// Refers to no index in the symbol list.
+	static constexpr uint32_t no_symbol = std::numeric_limits<uint32_t>::max();
+
+	/**
+	 * @brief The index of the text's symbol in the tree's symbol list, which it's added to if it
+	 * isn't there yet. The tree's own index is checked first, so the shared table is only locked
+	 * for text the tree hasn't used before.
+	 */
+	uint32_t local_symbol(std::string_view text);
+
+	void print(std::string& out, node_id id, const std::string& prefix) const;
+
+	/// The arrays the tree reads from, either its own or viewed ones.
+	struct arrays
+	{
+		const node* nodes;
+		size_t node_count;
+		const node_id* children;
+		size_t child_count;
+		const char* text;
+		size_t text_size;
+	};
+	arrays data() const
+	{
+		if (m_owner)
+		{
+			return m_viewed;
+		}
+		return { m_nodes.data(), m_nodes.size(), m_children.data(), m_children.size(), m_text.data(), m_text.size() };
+	}
+
+	std::vector<node> m_nodes;
+	/// The children of every node, each node's contiguous.
+	std::vector<node_id> m_children;
+	/// The text of every node, each node's contiguous.
+	std::string m_text;
+	/// The symbols used by the tree's nodes, which refer to them by index.
+	std::vector<symbol::id> m_symbols;
+	/// An open-addressed index of m_symbols by text, holding each symbol's index plus one, or 0 if empty.
+	std::vector<uint32_t> m_symbol_index;
+	/// The hash of each symbol's text, to skip comparing text that can't match, and to grow the index.
+	std::vector<uint64_t> m_symbol_hashes;
+	/// Each node's subtree hash, if hash-consing.
+	std::vector<uint64_t> m_hashes;
+	node_id m_root;
+
+	bool m_hash_cons;
+	/// Nodes by subtree hash, if hash-consing.
+	std::unordered_multimap<uint64_t, node_id> m_consed;
+
+	/// What a viewed tree's arrays live in, or null if it owns them.
+	std::shared_ptr<const void> m_owner;
+	arrays m_viewed;
+};
+
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "parser.hpp"
+
+/**
+ * @brief Runs many scripts in one process, on a pool of threads, writing each one's
+ * final variable trace to a file of its own.
+ *
+ * Every script gets an engine of its own. What scripts share, like the lexer's and parser's
+ * tables, the symbol table and the cache, is built once instead of once per process.
+ */
+namespace batch
+{
+
+/**
+ * @brief Call task(index, worker) for every index below count, on the given amount of threads,
+ * returning once every call has.
+ *
+ * Each thread starts with an even share of the indices. A thread that runs out steals half of
+ * what another has left, so a few long tasks don't leave the other threads idle.
+ *
+ * @remarks If a task throws, the first exception is rethrown once every thread has stopped.
+ */
+void for_each(size_t count, size_t threads, const std::function<void(size_t index, size_t worker)>& task);
+
+/// A script to run, and where its trace goes.
+struct script
+{
+	std::string path;
+	/// The trace's path, relative to the output directory.
+	std::string trace;
+};
+
+/**
+ * @brief Find the scripts to run.
+ *
+ * @param path Either a directory, where every .sl file in it and its subdirectories is run, or a
+ * manifest listing a path per line. Paths in a manifest are relative to it, and blank lines and
+ * lines starting with # are skipped.
+ * @return std::vector<script> The scripts, with traces named after where they are in the directory
+ * or the manifest's directory.
+ */
+std::vector<script> collect(const std::string& path);
+
+/// How a script is executed, once it's parsed.
+enum class executor
+{
+	interpret,
+	bytecode,
+	jit
+};
+
+/// How to load and run every script in a batch.
+struct options
+{
+	/// Where to write the traces and the report. Created if it doesn't exist.
+	std::string output_dir;
+	/// Where to cache lexed files and parse trees. Empty to not cache.
+	std::string cache_dir;
+	/// How to parse each script. Scripts are run in parallel, so each one's parsed on a single thread.
+	parser::options parse;
+	/// Whether to optimize each script before running it.
+	bool optimize = false;
+	executor execute = executor::interpret;
+	/// The amount of threads to run scripts on.
+	size_t jobs = 1;
+	/**
+	 * @brief A script to run once before the batch, if any. Every script starts from a fork of the
+	 * state it leaves, as if it were imported first, and only copies the variables it changes.
+	 */
+	std::string prefix;
+};
+
+/// How a single script went.
+struct result
+{
+	/// Whether it ran to the end.
+	bool ok = false;
+	/// Why it didn't, if it didn't.
+	std::string error;
+	/// The amount of variables it assigned.
+	size_t variables = 0;
+	/**
+	 * @brief Seconds spent lexing (with imports), parsing (with optimizing) and running (with compiling).
+	 * A tree from the cache is loaded in load, and a script that fails stops timing where it failed.
+	 */
+	double load	 = 0;
+	double parse = 0;
+	double run	 = 0;
+	/// Whether the parse tree came from the cache.
+	bool cached = false;
+	/// The thread it ran on.
+	size_t worker = 0;
+};
+
+/**
+ * @brief Run every script, writing each one's trace as soon as it finishes.
+ *
+ * A script that fails to load, parse or run doesn't stop the others. Its trace has the
+ * variables it assigned before it failed, and then the error. If the prefix fails, this throws
+ * without running any.
+ *
+ * @return std::vector<result> How each script went, in the same order as the scripts.
+ */
+std::vector<result> run(const std::vector<script>& scripts, const options& opts);
+
+/**
+ * @brief Write a report of how every script went, as tab separated values with a header,
+ * followed by the totals.
+ *
+ * @param elapsed The wall time the whole batch took, in seconds.
+ */
+void report(std::ostream& out, const std::vector<script>& scripts, const std::vector<result>& results, double elapsed);
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ast.hpp"
+#include "interpreter.hpp"
+#include "symbol.hpp"
+
+/**
+ * @brief Programs lowered into instructions for a stack machine, which runs them
+ * without walking the tree or comparing node types.
+ *
+ */
+namespace bytecode
+{
+
+/// What an instruction does. Arguments are indices into the program's tables.
+enum class opcode : uint8_t
+{
+	/// Push the constant.
+	load_const,
+	/// Push the variable, throwing if it's undefined.
+	load_var,
+	/// Push the variable, or an empty one if it's undefined, as arithmetic operands are.
+	load_operand,
+	/// Pop the right and then the left operand, and push them combined by the operator.
+	binary,
+	/// Pop into the variable.
+	store,
+	/// End the program.
+	halt
+};
+
+struct instruction
+{
+	opcode op;
+	uint32_t arg;
+};
+
+/// A compiled program.
+struct program
+{
+	std::vector<instruction> code;
+	std::vector<interpreter::variable> constants;
+	/// The name of each of the program's variables, which are numbered densely from 0.
+	std::vector<symbol::id> names;
+	/// The variables the program stores to, which are the only ones it changes.
+	std::vector<uint32_t> stored;
+	std::vector<std::string> operators;
+	/// The most values the program ever has on the stack.
+	size_t max_stack = 0;
+};
+
+/// Compile every top-level statement of a program.
+program compile(const ast::tree& code);
+
+/// Compile the given top-level statements, in order.
+program compile(const ast::tree& code, const std::vector<ast::node_id>& statements);
+
+/**
+ * @brief Run a program against the state, with the same results as interpreting its tree.
+ *
+ * The program's variables are given slots in the state and copied out of it first, so that every
+ * access after that is an indexed load. Only the variables it stores are written back.
+ *
+ * @remarks If a statement throws, the statements before it have still been run.
+ */
+void run(const program& code, interpreter::env& state);
+
+/// Disassemble a program, an instruction per line.
+std::string str(const program& code);
+
+}
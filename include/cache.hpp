@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "ast.hpp"
+#include "lexer.hpp"
+
+/**
+ * @brief An on-disk cache of work done on source files, keyed by a hash of their contents.
+ * 
+ */
+namespace cache
+{
+
+/// Bump whenever the lexer's output changes, so that stale cached tokens are never loaded.
+constexpr uint32_t version = 1;
+
+/// Bump whenever the parser's output or the tree layout changes, so that stale cached trees are never loaded.
+constexpr uint32_t tree_version = 2;
+
+/// The default cache directory, $XDG_CACHE_HOME/slang, or ~/.cache/slang.
+std::string default_directory();
+
+/**
+ * @brief Incrementally hashes data fed to it in pieces of any size.
+ * 
+ */
+class hasher
+{
+public:
+	hasher();
+
+	/// Hash the next piece of data.
+	void update(std::string_view data);
+
+	/// Get the hash of all the data so far.
+	uint64_t digest() const;
+
+private:
+	/// Mix a whole 8-byte word into the hash.
+	void mix(uint64_t word);
+
+	uint64_t m_hash;
+	uint64_t m_size;
+	/// Bytes left over that don't yet make a whole word.
+	uint64_t m_tail;
+	size_t m_tail_size;
+};
+
+/**
+ * @brief Load the cached tokens for code.
+ * 
+ * @param dir The cache directory.
+ * @param key The hash of the code.
+ * @param code The code the tokens were lexed from, which they'll view into.
+ * @return std::optional<std::vector<lexer::token>> The tokens, or nothing if they're not cached, or the cache entry is invalid.
+ */
+std::optional<std::vector<lexer::token>> load_tokens(const std::string& dir, uint64_t key, std::string_view code);
+
+/**
+ * @brief Cache the tokens lexed from code. Failing to write the cache entry isn't an error.
+ * 
+ * @param dir The cache directory.
+ * @param key The hash of the code.
+ * @param code The code the tokens were lexed from.
+ * @param tokens The tokens, which must view into code.
+ */
+void store_tokens(const std::string& dir, uint64_t key, std::string_view code, const std::vector<lexer::token>& tokens);
+
+/**
+ * @brief A file a cached parse tree was parsed from.
+ * 
+ */
+struct dependency
+{
+	/// The file's canonical path.
+	std::string path;
+	/// The hash of the file's contents.
+	uint64_t hash;
+	/// The file's imports: each path as written, joined onto the file's directory, and the canonical path it resolved to.
+	std::vector<std::pair<std::string, std::string>> imports;
+};
+
+/**
+ * @brief A parse tree loaded from the cache.
+ * 
+ */
+struct cached_tree
+{
+	/// The tree, viewing the mapped cache entry.
+	ast::tree tree;
+	/// The files the tree was parsed from, which it's stale if any have changed.
+	std::vector<dependency> dependencies;
+};
+
+/**
+ * @brief Map a cached parse tree, without copying it.
+ * 
+ * @param dir The cache directory.
+ * @param key The key the tree was stored under.
+ * @return std::optional<cached_tree> The tree, or nothing if it's not cached, or the cache entry is invalid.
+ */
+std::optional<cached_tree> load_tree(const std::string& dir, uint64_t key);
+
+/**
+ * @brief Cache a parse tree. Failing to write the cache entry isn't an error.
+ * 
+ * @param dir The cache directory.
+ * @param key The key to store the tree under.
+ * @param dependencies The files the tree was parsed from.
+ * @param tree The tree.
+ */
+void store_tree(const std::string& dir, uint64_t key, const std::vector<dependency>& dependencies, const ast::tree& tree);
+
+}
\ No newline at end of file
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace interpreter
+{
+
+/**
+ * @brief An array held in fixed size chunks, which forks of it share until one of them writes.
+ *
+ * Forking copies a pointer per chunk, and the first write to a shared chunk copies just that
+ * chunk. So many forks of a large array cost about what each of them changed, not its size.
+ *
+ * @remarks Arrays can only be copied by forking, since that stops the original writing in place too.
+ */
+template <typename T>
+class chunked
+{
+public:
+	/// The amount of elements in a chunk, which is copied whole on the first write to it.
+	static constexpr size_t chunk_bits = 6;
+	static constexpr size_t chunk_size = size_t(1) << chunk_bits;
+
+	chunked() = default;
+	chunked(const chunked&) = delete;
+	chunked& operator=(const chunked&) = delete;
+	chunked(chunked&&) noexcept = default;
+	chunked& operator=(chunked&&) noexcept = default;
+
+	size_t size() const
+	{
+		return m_size;
+	}
+
+	const T& operator[](size_t index) const
+	{
+		return (*m_chunks[index >> chunk_bits])[index & (chunk_size - 1)];
+	}
+
+	/// The element, to write to. Its chunk is copied first if it's shared.
+	T& write(size_t index)
+	{
+		size_t c = index >> chunk_bits;
+		if (!m_owned[c])
+		{
+			own(c);
+		}
+		return (*m_chunks[c])[index & (chunk_size - 1)];
+	}
+
+	void push_back(const T& value)
+	{
+		if (m_size % chunk_size == 0)
+		{
+			m_chunks.push_back(std::make_shared<chunk>());
+			m_owned.push_back(true);
+		}
+		write(m_size++) = value;
+	}
+
+	/// Add elements until there's the given amount. Never shrinks.
+	void grow(size_t size, const T& fill)
+	{
+		// Fill out the last chunk, then add whole chunks.
+		while (m_size < size && m_size % chunk_size != 0)
+		{
+			write(m_size++) = fill;
+		}
+		while (m_size < size)
+		{
+			auto added = std::make_shared<chunk>();
+			added->fill(fill);
+			m_chunks.push_back(std::move(added));
+			m_owned.push_back(true);
+			m_size = std::min(m_size + chunk_size, size);
+		}
+	}
+
+	/// A copy sharing every chunk with this array, which copies each chunk too before it next writes to it.
+	chunked fork()
+	{
+		std::fill(m_owned.begin(), m_owned.end(), false);
+		return share();
+	}
+
+	/**
+	 * @brief A copy sharing every chunk with this array, without changing it, so any amount of
+	 * threads can share one at once.
+	 *
+	 * @remarks Only for an array that doesn't write in place, such as a fork nothing's written to.
+	 */
+	chunked share() const
+	{
+		chunked copy;
+		copy.m_chunks = m_chunks;
+		copy.m_owned.assign(m_chunks.size(), false);
+		copy.m_size = m_size;
+		return copy;
+	}
+
+	/// The bytes of chunks no other array shares, and of the array's own table of them.
+	size_t unshared_bytes() const
+	{
+		size_t table = m_chunks.capacity() * sizeof(std::shared_ptr<chunk>) + m_owned.capacity();
+		return table + sizeof(chunk) * std::count_if(m_chunks.begin(), m_chunks.end(), [](const std::shared_ptr<chunk>& c) {
+						   return c.use_count() == 1;
+					   });
+	}
+
+private:
+	using chunk = std::array<T, chunk_size>;
+
+	/// Copy the chunk, so that nothing else sees what's written to it.
+	void own(size_t c)
+	{
+		// Even a chunk nothing else holds anymore is copied, since nothing orders writing to it
+		// after the reads of whichever thread let go of it last.
+		m_chunks[c] = std::make_shared<chunk>(*m_chunks[c]);
+		m_owned[c]	= true;
+	}
+
+	std::vector<std::shared_ptr<chunk>> m_chunks;
+	/// Whether each chunk is this array's alone, so it can be written in place.
+	std::vector<uint8_t> m_owned;
+	size_t m_size = 0;
+};
+
+}
@@ -1,15 +1,22 @@
 #pragma once
 
+#include <string_view>
+#include "ast.hpp"
 #include "interpreter.hpp"
-#include "parser.hpp"
 
 namespace eval
 {
 
-void assignment(interpreter::env& state, const parser::tree_node& node);
+void assignment(interpreter::env& state, const ast::tree& code, const interpreter::slot_table& slots, ast::node_id node);
 
-interpreter::variable expression(interpreter::env& state, const parser::tree_node& node);
+interpreter::variable expression(interpreter::env& state, const ast::tree& code, const interpreter::slot_table& slots, ast::node_id node);
 
-interpreter::variable arithmetic(interpreter::env& state, const parser::tree_node& node);
+interpreter::variable arithmetic(interpreter::env& state, const ast::tree& code, const interpreter::slot_table& slots, ast::node_id node);
+
+/// The value of an arithmetic operand. Undefined identifiers are empty.
+interpreter::variable operand(interpreter::env& state, const ast::tree& code, const interpreter::slot_table& slots, ast::node_id node);
+
+/// Apply a binary operator. Every way of running a program goes through this, so they all agree.
+interpreter::variable binary(const interpreter::variable& lhs, std::string_view oper, const interpreter::variable& rhs);
 
 }
\ No newline at end of file
@@ -1,40 +1,164 @@
 #pragma once
 
+#include <cstdint>
+#include <limits>
 #include <string>
-#include "parser.hpp"
+#include <string_view>
+#include <vector>
+#include "ast.hpp"
+#include "chunked.hpp"
+#include "symbol.hpp"
+#include "value.hpp"
 
 namespace interpreter
 {
 
+/// A variable's index in the state.
+using slot = uint32_t;
+
+/// Refers to no variable at all.
+constexpr slot no_slot = std::numeric_limits<slot>::max();
+
 /**
- * @brief A basic variable structure.
+ * @brief The interpreter's persistent state.
  * 
+ * Variables are indexed by slot. Every name in a program is given a slot before it's run,
+ * so running it never looks a name up.
+ *
+ * The variables are held in chunks that forks of the state share until they write to them,
+ * so a state can be forked for every variant of a script cheaply, and each fork costs about
+ * as much as the variables it changes.
  */
-struct variable
+class env
 {
+public:
+	env() = default;
+	env(env&&) noexcept = default;
+	env& operator=(env&&) noexcept = default;
+
+	/// The name's slot, which is added if the name doesn't have one yet.
+	slot resolve(symbol::id name);
+	slot resolve(std::string_view name);
+
+	/// The variable's value, if it has a slot and has been assigned.
+	const variable* find(std::string_view name) const;
+
+	/// The variable's value, which is empty if it hasn't been assigned.
+	const variable& value(slot var) const
+	{
+		return m_values[var];
+	}
+
+	/// Whether the variable has been assigned yet. Names get slots before they're assigned.
+	bool assigned(slot var) const
+	{
+		return m_assigned[var];
+	}
+
+	/// The variable's name.
+	symbol::id name(slot var) const
+	{
+		return m_names[var];
+	}
+
+	void assign(slot var, const variable& value)
+	{
+		m_values.write(var) = value;
+		// Only write the flag the first time, so that its chunk is only copied if it changes.
+		if (!m_assigned[var])
+		{
+			m_assigned.write(var) = true;
+		}
+	}
+
+	/// The amount of slots.
+	size_t size() const;
+
+	/// Every assigned variable as `name: type = value`, a line each, in slot order.
+	std::string trace() const;
+
+	/// A copy of the state, which shares its memory with this one until either of them changes it.
+	env fork();
 
-	std::string type;
-	std::string val;
+	/// The bytes of memory the state doesn't share with any other.
+	size_t unshared_bytes() const;
+
+private:
+	friend class snapshot;
+
+	/// A copy of a state that doesn't write in place, which leaves the original untouched.
+	env share() const;
+
+	/// Each variable's value.
+	chunked<variable> m_values;
+	chunked<uint8_t> m_assigned;
+	chunked<symbol::id> m_names;
+	/// The slot of each name, indexed by symbol. Symbols that aren't names have no_slot.
+	chunked<slot> m_slots;
 };
 
 /**
- * @brief The interpreter's persistent state.
- * 
+ * @brief A state frozen at some point, like after the prefix that many variants of a script share.
+ *
+ * Each variant forks the snapshot and runs only what follows the prefix. Forks share the snapshot's
+ * memory, and any number of threads can fork one at once.
  */
-struct env
+class snapshot
 {
-	env()
-	{
-		vars.clear();
-	}
+public:
+	/// Freeze the state as it is. It can go on running without changing the snapshot.
+	explicit snapshot(env& state);
+
+	/// A new state that starts out the same as the snapshot.
+	env fork() const;
 
-	std::unordered_map<std::string, variable> vars;
+	const env& state() const;
+
+private:
+	env m_state;
 };
 
+/// The slot of each identifier node in a tree, indexed by node. Other nodes have no_slot.
+using slot_table = std::vector<slot>;
+
 /**
- * @brief Interpret the lexed and parsed code.
- * 
+ * @brief Runs programs against a state of its own.
+ *
+ * Engines only share what never changes, like the lexer's and parser's tables, and the
+ * symbol table, which any thread can use. So any number of engines can run at once, a
+ * thread each. One engine mustn't be used from two threads at once.
  */
-env interpret(parser::tree_node& parsed_code);
+class engine
+{
+public:
+	engine() = default;
+
+	/// Start from a fork of the snapshot, instead of an empty state.
+	explicit engine(const snapshot& start);
+
+	/**
+	 * @brief Give every identifier in the tree a slot in the state.
+	 *
+	 * @param slots The nodes already resolved, which are skipped. The rest are added to it.
+	 */
+	void resolve(const ast::tree& code, slot_table& slots);
+
+	/// Run a single, resolved top-level statement against the state.
+	void execute(const ast::tree& code, const slot_table& slots, ast::node_id statement);
+
+	/**
+	 * @brief Interpret the lexed and parsed code.
+	 *
+	 * @return const env& The state after running it, whose variables stay defined for whatever's run next.
+	 */
+	const env& interpret(const ast::tree& parsed_code);
+
+	/// The persistent state, kept across calls.
+	env& state();
+	const env& state() const;
+
+private:
+	env m_state;
+};
 
-}
\ No newline at end of file
+}
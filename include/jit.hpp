@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ast.hpp"
+#include "interpreter.hpp"
+#include "symbol.hpp"
+
+/**
+ * @brief Straight-line runs of assignments compiled to native x86-64 code, which copies
+ * values between slots of the state directly.
+ *
+ * Anything the compiler can't handle is left to the interpreter, so every program runs,
+ * natively or not.
+ */
+namespace jit
+{
+
+/// Whether native code can be generated here. If not, every statement is interpreted.
+bool supported();
+
+/// Marks a block that's interpreted instead of run natively.
+constexpr size_t no_entry = std::numeric_limits<size_t>::max();
+
+/// A run of top-level statements, run by a single native function or by the interpreter.
+struct block
+{
+	/// Where the block's function starts in the native code, or no_entry.
+	size_t entry;
+	/// The block's statements, as a range of program::statements.
+	size_t begin;
+	size_t end;
+	/// The variables the block's function stores, as a range of program::stored.
+	size_t stored_begin = 0;
+	size_t stored_end	= 0;
+};
+
+/// A compiled program, which is tied to the engine its variables were given slots in.
+struct program
+{
+	/// The native code, mapped executable.
+	std::shared_ptr<const uint8_t> native;
+	size_t native_size = 0;
+	std::vector<block> blocks;
+	/// The program's assignments, in order.
+	std::vector<ast::node_id> statements;
+	std::vector<interpreter::variable> constants;
+	std::vector<std::string> operators;
+	/// The state's names when the program was compiled, in slot order.
+	std::vector<symbol::id> names;
+	/// The slot of each identifier node, for the interpreter.
+	interpreter::slot_table slots;
+	/// The variables each block's function stores, which are the only ones it changes.
+	std::vector<interpreter::slot> stored;
+	/// The most values any statement works on at once.
+	size_t temporaries = 0;
+	/// The amount of statements compiled to native code.
+	size_t compiled = 0;
+};
+
+/**
+ * @brief Compile a program, giving its variables slots in the engine's state.
+ *
+ * Statements are compiled in blocks that end at statements the compiler can't handle,
+ * which are interpreted instead.
+ */
+program compile(const ast::tree& code, interpreter::engine& engine);
+
+/**
+ * @brief Run a compiled program against the engine's state, with the same results as interpreting it.
+ *
+ * The program can be run against any engine whose state has the same variables in the same slots,
+ * such as a new one. Native code runs on a flat copy of the variables, and only the ones it stores
+ * are written back to the state.
+ *
+ * @remarks A statement that would throw is handed back to the interpreter, which throws
+ * the same error it always does. The statements before it have still been run.
+ */
+void run(const program& compiled, const ast::tree& code, interpreter::engine& engine);
+
+}
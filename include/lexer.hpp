@@ -1,27 +1,117 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace lexer
 {
 
+/**
+ * @brief The kinds of token in the language.
+ * 
+ */
+enum class token_kind : uint8_t
+{
+	identifier,
+	number,
+	string,
+	oper,
+	separator,
+	parens,
+	colon,
+	comma,
+	error
+};
+
 /**
  * @brief A single token.
  * 
+ * @remarks The token doesn't own its text, it views the code it was lexed from,
+ * which must outlive it.
  */
 struct token
 {
-	std::string type;
-	std::string value;
+	/// The kind of token.
+	token_kind kind;
+	/// If the text has carriage returns (and the blanks after them) the lexer skipped over.
+	bool stripped;
+	/// The token's span of the source code. For errors, all the remaining code.
+	std::string_view text;
+
+	/// The token type's name, "identifier", "number", ... or "ERROR".
+	std::string type() const;
+	/// The token's value, or the error message for errors.
+	std::string value() const;
+};
+
+/**
+ * @brief Lexes code that's made available a chunk at a time.
+ * 
+ * @remarks The code must grow in place and never move, since the tokens view into it.
+ */
+class chunked_lexer
+{
+public:
+	/// The least amount of unlexed code that's worth splitting across threads, in bytes.
+	static constexpr size_t parallel_threshold = 1 << 20;
+
+	/**
+	 * @brief Initialize the lexer.
+	 * 
+	 * @param jobs The most threads to lex with, once there's at least parallel_threshold bytes of code to lex.
+	 */
+	chunked_lexer(size_t jobs = 1);
+
+	/**
+	 * @brief Lex as much of the code available so far as possible.
+	 * 
+	 * @param code All the code so far.
+	 * @remarks Tokens that run into the end of the code are left for later, since the next chunk may extend them.
+	 */
+	void feed(std::string_view code);
+
+	/**
+	 * @brief Lex the rest of the code, once all of it is available.
+	 * 
+	 * @param code All the code.
+	 * @return std::vector<token> Every token in the code.
+	 */
+	std::vector<token> finish(std::string_view code);
+
+private:
+	/// Lex tokens from the cursor onwards. If partial, stops at the first token that reaches the end of the code.
+	void run(std::string_view code, bool partial);
+
+	/**
+	 * @brief Split the code from the cursor onwards into pieces, and lex them all at once.
+	 * 
+	 * @remarks Pieces are split just after separators that can't be part of a string,
+	 * so lexing each one from the start gives the same tokens as lexing them in order.
+	 */
+	void run_parallel(std::string_view code, bool partial);
+
+	/// The most threads to lex with.
+	size_t m_jobs;
+
+	/// The tokens lexed so far.
+	std::vector<token> m_tokens;
+	/// The position of the next token.
+	size_t m_pos;
+	/// Whether no token has been consumed yet.
+	bool m_raw;
+	/// Whether no token matched at m_pos, indicating a syntax error.
+	bool m_failed;
 };
 
 /**
  * @brief Tokenizes the input into a list of valid tokens.
  * 
- * @param code The input code.
+ * @param code The input code, which the tokens view into.
+ * @param jobs The most threads to lex with, if the code is long enough to be worth it.
  * @return std::vector<token> A list of valid tokens.
  */
-std::vector<token> lex(const std::string& code);
+std::vector<token> lex(std::string_view code, size_t jobs = 1);
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include "ast.hpp"
+
+/**
+ * @brief Rewrites parsed programs into ones that do less work, but leave the interpreter's
+ * state exactly as the original would have.
+ *
+ */
+namespace optimizer
+{
+
+/// What optimizing a program did.
+struct stats
+{
+	/// Arithmetic worked out ahead of time, and variables replaced by their known values.
+	size_t folded = 0;
+	/// Expressions replaced by a variable already holding their value.
+	size_t reused = 0;
+	/// Assignments removed because they're overwritten before they're read.
+	size_t dead_stores = 0;
+	/// Statements removed because they never do anything, like lone expressions.
+	size_t dropped = 0;
+	/// How many fewer nodes the optimized tree has.
+	size_t eliminated = 0;
+};
+
+/**
+ * @brief Optimize a program, folding constants, reusing common subexpressions and removing dead stores.
+ *
+ * Variables are given slots in the same order as in the original, so the whole state matches,
+ * not just the variables' values. Statements that may throw are never removed, and nothing is
+ * moved across them.
+ *
+ * @param code The program, which is hash-consed if the optimized one should be.
+ * @param report Filled in with what was done, if not null.
+ * @return ast::tree The optimized program.
+ */
+ast::tree optimize(const ast::tree& code, stats* report = nullptr);
+
+}
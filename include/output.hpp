@@ -1,36 +1,153 @@
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
 
 /**
  * @brief Manages what does and doesn't get sent to stdout based on the verbosity parameter.
  * 
+ * Messages are buffered, and only written once enough of them pile up, when flushed, or
+ * when the output is destroyed. Arguments that are callables are only called if the
+ * message is printed, so a message whose level is off costs nothing to skip.
  */
 class output
 {
 public:
-	/// Initialize with the global accepted verbosity level.
-	output(int verbosity);
+	/// How messages are printed.
+	enum class format
+	{
+		/// As they are.
+		text,
+		/// A JSON object per message, per line: {"time":seconds,"level":n,"message":"..."}.
+		json
+	};
+
+	/**
+	 * @brief Initialize with the global accepted verbosity level.
+	 * 
+	 * @param verbosity The highest verbosity to print.
+	 * @param style How to print messages.
+	 * @param async Whether to write the buffer out on a background thread.
+	 * @param sink Where to print to.
+	 */
+	output(int verbosity, format style = format::text, bool async = false, std::ostream& sink = std::cout);
+	/// Writes out whatever's still buffered.
+	~output();
+
+	output(const output&) = delete;
+	output& operator=(const output&) = delete;
+
+	/// Whether messages of the given verbosity are printed at all.
+	bool enabled(int intended_verbosity) const
+	{
+		return intended_verbosity <= m_verbosity;
+	}
 
 	/**
 	 * @brief Output to stdout. Will not output anything with a higher verbosity than the intended one.
 	 * 
-	 * @tparam Printable Any type that can be passed to std::ostream::operator<<
+	 * @tparam Printable Any types that can be passed to std::ostream::operator<<, or callables returning one,
+	 * which are only called if the message is printed.
 	 * @param intended_verbosity The indended verbosity of the message to be printed.
-	 * @param p The string / variable to send to stdout.
+	 * @param p The strings / variables to send to stdout, one after another.
 	 * @return output& *this
 	 */
-	template <typename Printable>
-	output& operator()(int intended_verbosity, Printable p)
+	template <typename... Printable>
+	output& operator()(int intended_verbosity, Printable&&... p)
 	{
-		if (intended_verbosity <= m_verbosity)
+		if (!enabled(intended_verbosity))
 		{
-			std::cout << p << std::flush;
+			return *this;
+		}
+
+		std::unique_lock lock(m_mutex);
+		// Text goes straight into the buffer, but JSON has to be escaped first.
+		std::string& message = m_style == format::text ? m_buffer : m_message;
+		m_message.clear();
+		(append(message, std::forward<Printable>(p)), ...);
+		if (m_style == format::json)
+		{
+			record(intended_verbosity, "message", m_message);
+		}
+		if (m_buffer.size() >= buffer_size)
+		{
+			drain(lock);
 		}
 		return *this;
 	}
 
+	/// Print an error to stderr, after everything printed so far.
+	void error(std::string_view message);
+
+	/// Write out everything buffered, and wait for it to be written.
+	void flush();
+
+	/// How much is buffered before it's written out.
+	static constexpr size_t buffer_size = 1 << 16;
+	/// How much can wait on the background writer before messages block.
+	static constexpr size_t max_pending = 1 << 24;
+
 private:
+	/// Append something printable to a message.
+	template <typename Printable>
+	static void append(std::string& message, Printable&& p)
+	{
+		using type = std::decay_t<Printable>;
+		if constexpr (std::is_invocable_v<type>)
+		{
+			append(message, p());
+		}
+		else if constexpr (std::is_same_v<type, char>)
+		{
+			message += p;
+		}
+		else if constexpr (std::is_convertible_v<const type&, std::string_view>)
+		{
+			message += std::string_view(p);
+		}
+		else
+		{
+			std::ostringstream ss;
+			ss << p;
+			message += ss.str();
+		}
+	}
+
+	/// Add a JSON record of a message to the buffer.
+	void record(int intended_verbosity, std::string_view field, std::string_view message);
+
+	/// Hand the buffer to the writer, or write it right away if there's no writer thread.
+	void drain(std::unique_lock<std::mutex>& lock);
+
+	/// The background writer's loop.
+	void write_loop();
+
 	/// The output verbosity.
 	int m_verbosity;
-};
\ No newline at end of file
+	format m_style;
+	std::ostream& m_sink;
+	std::chrono::steady_clock::time_point m_start;
+
+	std::mutex m_mutex;
+	/// Messages not yet handed off to be written.
+	std::string m_buffer;
+	/// The message being formatted, if it needs escaping.
+	std::string m_message;
+
+	/// The background writer, if writing asynchronously.
+	std::thread m_writer;
+	std::condition_variable m_wake;
+	std::condition_variable m_written;
+	/// Messages handed off to the writer.
+	std::string m_pending;
+	bool m_writing;
+	bool m_stopping;
+};
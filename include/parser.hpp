@@ -4,11 +4,13 @@
 #include <optional>
 #include <string>
 #include <vector>
+#include "ast.hpp"
 #include "lexer.hpp"
 
 namespace parser
 {
 
+/// The rewrite engine's working tree. Parsed programs are handed out as an ast::tree.
 class tree_node
 {
 public:
@@ -40,8 +42,8 @@ public:
 	/// Check recursively for equality.
 	bool operator==(const tree_node& other) const;
 
-	std::string type() const;
-	std::string value() const;
+	const std::string& type() const;
+	const std::string& value() const;
 
 	/// For iterating over all children.
 	const std::vector<tree_node>& children() const;
@@ -66,6 +68,54 @@ private:
 	std::vector<tree_node> m_children;
 };
 
-tree_node parse(std::vector<lexer::token> tokens);
+/// The available parsing engines.
+enum class engine
+{
+	/// Single pass recursive descent, with precedence climbing for arithmetic.
+	pratt,
+	/// The original engine, rewriting the token list with `expressions` until nothing changes.
+	rewrite
+};
+
+/// Counters from the rewrite engine's packrat memo.
+struct memo_stats
+{
+	/// Rule matches answered from the memo.
+	size_t hits = 0;
+	/// Rule matches that had to be evaluated.
+	size_t misses = 0;
+};
+
+/// How to parse a program.
+struct options
+{
+	/// The engine to parse with. The rewrite engine is kept for differential testing.
+	engine method = engine::pratt;
+	/// Store structurally identical subtrees only once.
+	bool hash_cons = false;
+	/// The most threads to parse with. Only the Pratt parser parses in parallel.
+	size_t jobs = 1;
+	/// The fewest tokens worth splitting across threads.
+	size_t parallel_threshold = 1 << 16;
+};
+
+/**
+ * @brief Parse a list of tokens into a program tree.
+ *
+ * @remarks The tree views the tokens' source text, which must outlive it.
+ * @param tokens The lexed tokens.
+ * @param opts How to parse them.
+ * @param stats If given, receives the rewrite engine's memo counters.
+ */
+ast::tree parse(const std::vector<lexer::token>& tokens, const options& opts = {}, memo_stats* stats = nullptr);
+
+/**
+ * @brief Parse tokens with the Pratt parser onto the end of an existing tree, leaving the rest of it untouched.
+ *
+ * @param tree The tree to add to. Its root isn't changed.
+ * @param tokens The lexed tokens, which must not end mid-statement.
+ * @return std::vector<ast::node_id> The top-level statements parsed, in order.
+ */
+std::vector<ast::node_id> parse_into(ast::tree& tree, const std::vector<lexer::token>& tokens);
 
 }
\ No newline at end of file
@@ -1,16 +1,137 @@
 #pragma once
 
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
 #include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "ast.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "source.hpp"
 
 namespace preprocessor
 {
 
+/// An import directive, and the file it imports.
+struct import_directive
+{
+	/// The index of the directive's `import` token.
+	size_t index;
+	/// The imported path, joined onto the importing file's directory.
+	std::string path;
+	/// The canonical form of path.
+	std::string canonical;
+};
+
+/**
+ * @brief A single source file, and the tokens lexed from it.
+ * 
+ */
+struct module
+{
+	/// The canonical path to the file.
+	std::string path;
+	/// The mapped file, which the tokens view into.
+	std::unique_ptr<source> file;
+	/// The file's tokens, before any imports are spliced in.
+	std::vector<lexer::token> tokens;
+	/// The file's import directives, in order.
+	std::vector<import_directive> imports;
+	/// The hash of the file's contents, if caching.
+	uint64_t hash;
+	/// Whether the tokens were loaded from the cache, instead of lexed.
+	bool cached;
+};
+
 /**
- * @brief For any extra necessary code preprocessing.
+ * @brief Loads a source file and every file it imports, with the directive
  * 
- * @param in The raw code file's contents
- * @return std::string The pre-processed code.
+ * import "path/to/file.sl"
+ * 
+ * on its own line. Paths are relative to the importing file. Each file is spliced
+ * into the program once, where it's first imported, and files are loaded concurrently.
+ * 
+ */
+class loader
+{
+public:
+	/**
+	 * @brief Initialize the loader.
+	 * 
+	 * @param cache_dir Where to cache each file's tokens, keyed by its contents. Empty to not cache.
+	 * @param jobs The most threads to load with. The files in a layer of imports are loaded in
+	 * parallel, and a file loaded on its own is lexed in parallel instead.
+	 */
+	loader(std::string cache_dir, size_t jobs);
+
+	/**
+	 * @brief Load the program, throwing if a file can't be opened.
+	 * 
+	 * @param path The path to the program's entry file.
+	 * @return std::vector<lexer::token> The whole program's tokens, which view into the loaded files.
+	 */
+	std::vector<lexer::token> load(const std::string& path);
+
+	/// All the loaded modules, by canonical path.
+	const std::map<std::string, std::unique_ptr<module>>& modules() const;
+
+	/// Whether files and parse trees are cached at all.
+	bool caching() const;
+
+	/**
+	 * @brief Find where a token is, for diagnostics.
+	 * 
+	 * @return std::tuple<std::string, size_t, size_t> The file's path, and the line and column.
+	 */
+	std::tuple<std::string, size_t, size_t> locate(const lexer::token& tok) const;
+
+	/**
+	 * @brief Load the program's parse tree from the cache, if it's there and none of the files
+	 * it was parsed from have changed since.
+	 * 
+	 * @param path The path to the program's entry file.
+	 * @param variant Tells apart trees parsed differently from the same files.
+	 * @return std::optional<ast::tree> The tree, viewing the mapped cache entry.
+	 */
+	std::optional<ast::tree> load_tree(const std::string& path, uint64_t variant) const;
+
+	/// Cache the parse tree of the program last loaded.
+	void store_tree(const ast::tree& tree, uint64_t variant) const;
+
+private:
+	/// Map, hash and lex (or load from cache) a single file, lexing on at most the given amount of threads.
+	std::unique_ptr<module> load_module(const std::string& path, size_t jobs) const;
+
+	/**
+	 * @brief Append the module's tokens, with its imports spliced in.
+	 * 
+	 * @return bool False if there was a lexer error, which ends the program.
+	 */
+	bool splice(const module& mod, std::vector<lexer::token>& program, std::set<std::string>& spliced) const;
+
+	/// The parse tree cache key for an entry file with the given contents.
+	uint64_t tree_key(const std::string& entry, uint64_t hash, uint64_t variant) const;
+
+	std::string m_cache_dir;
+	size_t m_jobs;
+
+	/// The canonical path of the program last loaded.
+	std::string m_entry;
+
+	std::map<std::string, std::unique_ptr<module>> m_modules;
+};
+
+/**
+ * @brief The variant that tells apart trees parsed with different options from the same files.
+ * The amount of jobs doesn't change the tree, so it's left out.
+ *
+ * @param optimized Whether the tree is optimized before it's cached.
  */
-std::string preprocess(const std::string& in);
+uint64_t tree_variant(const parser::options& opts, bool optimized);
 
-}
\ No newline at end of file
+}
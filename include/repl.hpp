@@ -0,0 +1,57 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "ast.hpp"
+#include "interpreter.hpp"
+#include "parser.hpp"
+
+namespace repl
+{
+
+/**
+ * @brief An interactive session, which runs each line as it's entered against an engine's state.
+ *
+ * Every line is lexed and parsed on its own, and its statements are added to the end of
+ * the session's program. Nothing entered before is lexed, parsed or run again, so a
+ * line takes as long as it would at the start of the session.
+ */
+class session
+{
+public:
+	/**
+	 * @brief Initialize the session.
+	 *
+	 * @param engine What to run the lines with, whose variables are already defined in the session.
+	 * @param hash_cons Whether to hash-cons the session's program.
+	 */
+	session(interpreter::engine& engine, bool hash_cons);
+
+	/**
+	 * @brief Lex, parse and run a line.
+	 *
+	 * @remarks A line that doesn't lex or parse is dropped, and throws. A line that fails
+	 * while running stays in the program, but the statements after the failing one aren't run.
+	 * @return std::vector<ast::node_id> The line's statements.
+	 */
+	std::vector<ast::node_id> feed(const std::string& line);
+
+	/// Read lines until the input ends, printing what each assigned and any errors.
+	void run(std::istream& in, std::ostream& out);
+
+	/// Everything entered so far.
+	const ast::tree& program() const;
+	/// The top-level statements entered so far, in order.
+	const std::vector<ast::node_id>& statements() const;
+
+private:
+	interpreter::engine& m_engine;
+	ast::tree m_program;
+	std::vector<ast::node_id> m_statements;
+	/// The program's identifiers' slots, resolved a line at a time.
+	interpreter::slot_table m_slots;
+};
+
+}
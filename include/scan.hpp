@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string_view>
+
+/**
+ * @brief Vectorized kernels for scanning runs of a character class, used by the lexer.
+ * 
+ * @remarks The kernels are picked at startup from the best the CPU supports, see scan::use().
+ */
+namespace scan
+{
+
+/**
+ * @brief The available kernel implementations.
+ * 
+ */
+enum class level
+{
+	scalar,
+	sse2,
+	avx2
+};
+
+/// The best kernel implementation the CPU supports.
+level best();
+
+/// Switch to the given kernel implementation, or the best supported one if it isn't.
+void use(level l);
+
+/// The kernel implementation in use.
+level current();
+
+/// The name of a kernel implementation, for printing.
+const char* name(level l);
+
+/// Get the first position at or after pos that isn't a blank: space, \t, \v, \f or \r.
+size_t skip_blank(std::string_view code, size_t pos);
+
+/// Get the first position at or after pos that isn't an identifier character, [A-Za-z0-9].
+size_t skip_alnum(std::string_view code, size_t pos);
+
+/// Get the first position at or after pos that isn't a digit.
+size_t skip_digits(std::string_view code, size_t pos);
+
+/**
+ * @brief Get the position of the next character a string literal can't span, or the end of the code.
+ * 
+ * @param code The code
+ * @param pos Where to start looking.
+ * @param stop_at_cr Whether carriage returns end the line, as well as \n and \0.
+ */
+size_t find_line_end(std::string_view code, size_t pos, bool stop_at_cr);
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A read-only view of a source file, memory-mapped so that it's
+ * never copied into memory as a whole.
+ * 
+ */
+class source
+{
+public:
+	/// The amount of code processed at a time, in bytes.
+	static constexpr size_t chunk_size = 4 << 20;
+
+	/// Map the file at the given path.
+	source(const std::string& path);
+	~source();
+
+	source(const source& other) = delete;
+	source& operator=(const source& other) = delete;
+
+	/// False if the file couldn't be opened.
+	explicit operator bool() const;
+
+	/// The whole file's contents.
+	std::string_view view() const;
+	/// The size of the file, in bytes.
+	size_t size() const;
+
+	/**
+	 * @brief Get the end of the chunk starting at begin.
+	 * 
+	 * @remarks Chunks are about chunk_size bytes, and are extended to end on a line boundary.
+	 */
+	size_t chunk_end(size_t begin) const;
+
+	/**
+	 * @brief Tell the kernel the given range won't be read again soon, so its pages can be dropped.
+	 * Everything before begin must have been released already.
+	 * 
+	 * @remarks The range is still valid to read afterwards, it will just be paged back in from the file.
+	 */
+	void release(size_t begin, size_t end) const;
+
+	/**
+	 * @brief Get the line and column of an offset into the file, both starting at 1, for diagnostics.
+	 * 
+	 * @remarks The first call indexes where every line starts, so it reads the whole file.
+	 */
+	std::pair<size_t, size_t> position(size_t offset) const;
+
+private:
+	/// The mapped file, or nullptr if it's empty or couldn't be mapped.
+	const char* m_data;
+	size_t m_size;
+	bool m_open;
+
+	/// The file's contents, if it can't be mapped (e.g. it's a pipe).
+	std::string m_fallback;
+
+	/// The offset every line starts at, built on demand.
+	mutable std::vector<size_t> m_lines;
+};
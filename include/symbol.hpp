@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+
+/**
+ * @brief Interned text, shared by the whole process. Identifiers and string literals are
+ * stored once, and everything else refers to them by a dense id, so comparing two is
+ * comparing integers.
+ *
+ */
+namespace symbol
+{
+
+/// A symbol's index in the table. Ids are handed out densely from 0.
+using id = uint32_t;
+
+/// Refers to no symbol at all.
+constexpr id none = std::numeric_limits<id>::max();
+
+/// Symbols per block of the table.
+constexpr size_t block_size = 1 << 12;
+/// The most blocks the table can grow to.
+constexpr size_t max_blocks = 1 << 16;
+
+/// The table's blocks. They're added as the table grows and never move, so text is read without a lock.
+extern std::atomic<std::string_view*> blocks[max_blocks];
+
+/// The symbol with the given text, which is added if there isn't one yet. Safe to call from any thread.
+id intern(std::string_view text);
+
+/// The symbol with the given text, or none if it was never interned.
+id find(std::string_view text);
+
+/// The symbol's text, which stays alive and in place for as long as the program runs.
+inline std::string_view text(id sym)
+{
+	return blocks[sym / block_size].load(std::memory_order_acquire)[sym % block_size];
+}
+
+/// The size of the table.
+struct statistics
+{
+	/// The amount of symbols.
+	size_t symbols;
+	/// The bytes of text they hold.
+	size_t stored;
+};
+
+statistics stats();
+
+}
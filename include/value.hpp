@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include "ast.hpp"
+#include "symbol.hpp"
+
+namespace interpreter
+{
+
+/**
+ * @brief A variable's value, held in 16 bytes: a number, or text that's either stored
+ * inline if it's short or interned if it isn't.
+ *
+ * A value has the type of the node it came from, and is only turned back into text
+ * when it's printed. Values don't own anything, so they're copied as plain bytes.
+ */
+class variable
+{
+public:
+	/// Create an empty value, with no type.
+	variable();
+
+	/**
+	 * @brief Create a value from a literal's text.
+	 *
+	 * @remarks Numbers are stored as integers if that prints them back the same, and as text otherwise.
+	 */
+	variable(ast::kind type, std::string_view text);
+
+	/// Create a value from a literal node, reusing its symbol if it has one.
+	variable(const ast::tree& code, ast::node_id node);
+
+	/// Create a number.
+	static variable integer(int64_t value);
+	static variable real(double value);
+
+	/// The name of the value's type, or an empty string if it has none.
+	const std::string& type() const;
+	/// The kind of node the value came from. Only meaningful if it isn't empty.
+	ast::kind kind() const;
+	/// Whether the value has no type, like an undefined operand's.
+	bool empty() const;
+	/// The value as text.
+	std::string value() const;
+
+	bool operator==(const variable& other) const;
+	bool operator!=(const variable& other) const;
+
+private:
+	/// How the value is stored.
+	enum class storage : uint8_t
+	{
+		/// Nothing, and no type either.
+		empty,
+		integer,
+		real,
+		/// Text in m_bytes, m_length long.
+		inline_text,
+		/// The symbol of interned text in m_bytes.
+		interned_text
+	};
+
+	/// The most text that's stored inline.
+	static constexpr size_t inline_size = 13;
+
+	template <typename T>
+	T get() const
+	{
+		T ret;
+		std::memcpy(&ret, m_bytes, sizeof(T));
+		return ret;
+	}
+
+	template <typename T>
+	void set(T value)
+	{
+		std::memcpy(m_bytes, &value, sizeof(T));
+	}
+
+	std::string_view text() const;
+	/// Store text that's too long to go inline.
+	void set_interned(symbol::id sym);
+
+	alignas(8) char m_bytes[inline_size];
+	/// The length of inline text.
+	uint8_t m_length;
+	storage m_storage;
+	ast::kind m_type;
+};
+
+static_assert(sizeof(variable) <= 16, "Values must fit in 16 bytes.");
+
+}
@@ -0,0 +1,580 @@
+#include "ast.hpp"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace ast
+{
+
+static const std::string kind_names[] = {
+	"identifier",
+	"number",
+	"string",
+	"operator",
+	"separator",
+	"parens",
+	"colon",
+	"comma",
+	"error",
+	"entry",
+	"arithmetic",
+	"assignment",
+	"nop",
+	"expression"
+};
+
+const std::string& name(kind k)
+{
+	return kind_names[static_cast<size_t>(k)];
+}
+
+std::optional<kind> kind_of(std::string_view name)
+{
+	auto found = std::find(std::begin(kind_names), std::end(kind_names), name);
+	if (found == std::end(kind_names))
+	{
+		return {};
+	}
+	return static_cast<kind>(found - std::begin(kind_names));
+}
+
+tree::tree(bool hash_cons)
+	: m_root(no_node), m_hash_cons(hash_cons), m_viewed{}
+{
+}
+
+node_id tree::leaf(const lexer::token& tok)
+{
+	static_assert(static_cast<int>(kind::error) == static_cast<int>(lexer::token_kind::error),
+				  "Leaf kinds must line up with token kinds.");
+	kind type = static_cast<kind>(tok.kind);
+	if (tok.stripped || tok.kind == lexer::token_kind::error)
+	{
+		return leaf(type, tok.value());
+	}
+	return leaf(type, tok.text);
+}
+
+node_id tree::leaf(kind type, std::string_view text)
+{
+	const node_id* none = nullptr;
+	return add_branch(type, none, none, text);
+}
+
+template <typename It>
+node_id tree::add_branch(kind type, It begin, It end, std::string_view text)
+{
+	uint32_t local = interned(type) ? local_symbol(text) : no_symbol;
+	uint64_t hash  = m_hash_cons ? hash_of(type, text, begin, end) : 0;
+	if (node_id found = find(hash, type, text, local, begin, end); found != no_node)
+	{
+		return found;
+	}
+	return insert(hash, type, text, local, begin, end);
+}
+
+node_id tree::branch(kind type, const std::vector<node_id>& children, std::string_view text)
+{
+	return add_branch(type, children.begin(), children.end(), text);
+}
+
+node_id tree::branch(kind type, std::initializer_list<node_id> children, std::string_view text)
+{
+	return add_branch(type, children.begin(), children.end(), text);
+}
+
+template <typename It>
+uint64_t tree::hash_of(kind type, std::string_view text, It begin, It end) const
+{
+	uint64_t hash = std::hash<std::string_view>()(text) ^ (static_cast<uint64_t>(type) << 56);
+	for (It child = begin; child != end; ++child)
+	{
+		hash ^= this->hash(*child) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+	}
+	return hash;
+}
+
+template <typename It>
+node_id tree::find(uint64_t hash, kind type, std::string_view text, uint32_t local, It begin, It end) const
+{
+	if (!m_hash_cons)
+	{
+		return no_node;
+	}
+
+	auto [first, last] = m_consed.equal_range(hash);
+	for (auto candidate = first; candidate != last; ++candidate)
+	{
+		const node& n = m_nodes[candidate->second];
+		// Children are consed already, so comparing their ids is enough. So is comparing symbols.
+		if (n.type == type &&
+			(local != no_symbol ? n.text_offset == local : this->text(candidate->second) == text) &&
+			std::equal(begin, end, m_children.begin() + n.first_child, m_children.begin() + n.first_child + n.child_count))
+		{
+			return candidate->second;
+		}
+	}
+	return no_node;
+}
+
+template <typename It>
+node_id tree::insert(uint64_t hash, kind type, std::string_view text, uint32_t local, It begin, It end)
+{
+	if (m_owner)
+	{
+		throw std::runtime_error("Cannot add to a tree viewed from memory it doesn't own.");
+	}
+
+	node_id id = m_nodes.size();
+	if (local != no_symbol)
+	{
+		m_nodes.push_back({ type, no_node, (uint32_t)m_children.size(), (uint32_t)(end - begin), local, (uint32_t)text.size() });
+	}
+	else
+	{
+		m_nodes.push_back({ type, no_node, (uint32_t)m_children.size(), (uint32_t)(end - begin), (uint32_t)m_text.size(), (uint32_t)text.size() });
+		m_text.append(text);
+	}
+	for (It child = begin; child != end; ++child)
+	{
+		if (m_nodes[*child].parent == no_node)
+		{
+			m_nodes[*child].parent = id;
+		}
+		m_children.push_back(*child);
+	}
+	if (m_hash_cons)
+	{
+		m_hashes.push_back(hash);
+		m_consed.emplace(hash, id);
+	}
+	return id;
+}
+
+uint32_t tree::local_symbol(std::string_view text)
+{
+	uint64_t hash = std::hash<std::string_view>()(text);
+	size_t mask	  = m_symbol_index.size() - 1;
+	size_t at	  = hash & mask;
+	for (; !m_symbol_index.empty() && m_symbol_index[at] != 0; at = (at + 1) & mask)
+	{
+		uint32_t local = m_symbol_index[at] - 1;
+		if (m_symbol_hashes[local] == hash && symbol::text(m_symbols[local]) == text)
+		{
+			return local;
+		}
+	}
+	if (m_owner)
+	{
+		throw std::runtime_error("Cannot add to a tree viewed from memory it doesn't own.");
+	}
+
+	uint32_t added = m_symbols.size();
+	m_symbols.push_back(symbol::intern(text));
+	m_symbol_hashes.push_back(hash);
+
+	// Keep the index at most half full, so probes stay short.
+	if (m_symbols.size() * 2 > m_symbol_index.size())
+	{
+		m_symbol_index.assign(std::max<size_t>(m_symbol_index.size() * 2, 64), 0);
+		mask = m_symbol_index.size() - 1;
+		for (uint32_t local = 0; local < m_symbols.size(); ++local)
+		{
+			at = m_symbol_hashes[local] & mask;
+			while (m_symbol_index[at] != 0)
+			{
+				at = (at + 1) & mask;
+			}
+			m_symbol_index[at] = local + 1;
+		}
+	}
+	else
+	{
+		m_symbol_index[at] = added + 1;
+	}
+	return added;
+}
+
+std::vector<node_id> tree::append(const tree& other)
+{
+	arrays from = other.data();
+	std::vector<node_id> ids(from.node_count);
+
+	// Children come before their parents, so they're always mapped already.
+	std::vector<node_id> children;
+	for (size_t id = 0; id < from.node_count; ++id)
+	{
+		children.clear();
+		for (node_id child : other.children(id))
+		{
+			children.push_back(ids[child]);
+		}
+		ids[id] = add_branch(from.nodes[id].type, children.begin(), children.end(), other.text(id));
+	}
+	return ids;
+}
+
+std::pair<tree, std::vector<node_id>> tree::concat(const std::vector<tree>& pieces)
+{
+	// Where each piece's arrays start in the joined tree.
+	struct offsets
+	{
+		size_t node;
+		size_t child;
+		size_t text;
+	};
+	std::vector<offsets> starts;
+	offsets end = { 0, 0, 0 };
+	for (auto& piece : pieces)
+	{
+		if (piece.m_hash_cons)
+		{
+			throw std::runtime_error("Cannot concatenate hash-consed trees, append them instead.");
+		}
+		arrays from = piece.data();
+		starts.push_back(end);
+		end.node += from.node_count;
+		end.child += from.child_count;
+		end.text += from.text_size;
+	}
+	if (end.node > no_node || end.child > std::numeric_limits<uint32_t>::max() ||
+		end.text > std::numeric_limits<uint32_t>::max())
+	{
+		throw std::runtime_error("Concatenated tree is too large.");
+	}
+
+	tree joined;
+	joined.m_nodes.resize(end.node);
+	joined.m_children.resize(end.child);
+	joined.m_text.resize(end.text);
+
+	// Symbols are numbered per tree, so each piece's are renumbered into the joined tree's list first.
+	std::vector<std::vector<uint32_t>> renumbered(pieces.size());
+	for (size_t i = 0; i < pieces.size(); ++i)
+	{
+		for (symbol::id sym : pieces[i].m_symbols)
+		{
+			renumbered[i].push_back(joined.local_symbol(symbol::text(sym)));
+		}
+	}
+
+	// Nothing is shared, so every piece's nodes just move up by the size of the pieces before it.
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < pieces.size(); ++i)
+	{
+		threads.emplace_back([&joined, &symbols = renumbered[i], from = pieces[i].data(), at = starts[i]] {
+			for (size_t id = 0; id < from.node_count; ++id)
+			{
+				node n		  = from.nodes[id];
+				n.parent	  = n.parent == no_node ? no_node : n.parent + at.node;
+				n.first_child += at.child;
+				n.text_offset = interned(n.type) ? symbols[n.text_offset] : n.text_offset + at.text;
+				joined.m_nodes[at.node + id] = n;
+			}
+			for (size_t c = 0; c < from.child_count; ++c)
+			{
+				joined.m_children[at.child + c] = from.children[c] + at.node;
+			}
+			std::copy(from.text, from.text + from.text_size, joined.m_text.begin() + at.text);
+		});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	std::vector<node_id> bases;
+	for (auto& start : starts)
+	{
+		bases.push_back(start.node);
+	}
+	return { std::move(joined), bases };
+}
+
+tree::position tree::mark() const
+{
+	return { m_nodes.size(), m_children.size(), m_text.size() };
+}
+
+void tree::rewind(position mark)
+{
+	// Nodes from before the mark may have been given a parent since.
+	for (size_t i = mark.children; i < m_children.size(); ++i)
+	{
+		node& child = m_nodes[m_children[i]];
+		if (child.parent != no_node && child.parent >= mark.nodes)
+		{
+			child.parent = no_node;
+		}
+	}
+	if (m_hash_cons)
+	{
+		for (size_t id = mark.nodes; id < m_nodes.size(); ++id)
+		{
+			auto [first, last] = m_consed.equal_range(m_hashes[id]);
+			m_consed.erase(std::find_if(first, last, [id](auto& entry) { return entry.second == id; }));
+		}
+		m_hashes.resize(mark.nodes);
+	}
+	m_text.resize(mark.text);
+	m_nodes.resize(mark.nodes);
+	m_children.resize(mark.children);
+}
+
+void tree::set_root(node_id id)
+{
+	m_root = id;
+}
+
+node_id tree::root() const
+{
+	return m_root;
+}
+
+std::string tree::value(node_id id) const
+{
+	return std::string(text(id));
+}
+
+uint64_t tree::hash(node_id id) const
+{
+	if (id < m_hashes.size())
+	{
+		return m_hashes[id];
+	}
+	child_range range = children(id);
+	return hash_of(type(id), text(id), range.begin(), range.end());
+}
+
+bool tree::equal(node_id a, node_id b) const
+{
+	if (a == b)
+	{
+		return true;
+	}
+	if (m_hash_cons)
+	{
+		return false;
+	}
+
+	child_range x = children(a);
+	child_range y = children(b);
+	if (type(a) != type(b) || x.size() != y.size() ||
+		(interned(type(a)) ? symbol(a) != symbol(b) : text(a) != text(b)))
+	{
+		return false;
+	}
+	for (size_t i = 0; i < x.size(); ++i)
+	{
+		if (!equal(x[i], y[i]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t tree::expanded_size() const
+{
+	// Children are always added before their parents.
+	std::vector<size_t> sizes(size());
+	for (size_t id = 0; id < sizes.size(); ++id)
+	{
+		sizes[id] = 1;
+		for (node_id child : children(id))
+		{
+			sizes[id] += sizes[child];
+		}
+	}
+	return m_root == no_node ? 0 : sizes[m_root];
+}
+
+bool tree::hash_consed() const
+{
+	return m_hash_cons;
+}
+
+std::string tree::str() const
+{
+	std::string out;
+	if (m_root != no_node)
+	{
+		print(out, m_root, "");
+	}
+	return out;
+}
+
+void tree::print(std::string& out, node_id id, const std::string& prefix) const
+{
+	out += prefix;
+	out += name(type(id));
+	out += ": ";
+	out += text(id);
+	out += "\n";
+
+	for (node_id child : children(id))
+	{
+		print(out, child, ".." + prefix);
+	}
+}
+
+//! SERIALIZATION
+
+/// The header of a written tree, followed by its node, child and text arrays, then the length and text of each of its symbols.
+struct tree_header
+{
+	uint64_t node_count;
+	uint64_t child_count;
+	uint64_t text_size;
+	uint64_t symbol_count;
+	uint64_t symbol_text_size;
+	node_id root;
+	/// sizeof(node) in the build that wrote the tree.
+	uint32_t node_size;
+	uint8_t hash_consed;
+	uint8_t reserved[7];
+};
+
+/// Round up to a multiple of 8 bytes.
+static size_t aligned(size_t size)
+{
+	return (size + 7) & ~size_t(7);
+}
+
+void tree::write(std::ostream& out) const
+{
+	arrays a = data();
+	tree_header header;
+	std::memset(&header, 0, sizeof(header));
+	header.node_count  = a.node_count;
+	header.child_count = a.child_count;
+	header.text_size   = a.text_size;
+	header.root		   = m_root;
+	header.node_size   = sizeof(node);
+	header.hash_consed = m_hash_cons;
+
+	// Symbol ids only mean something to this process, so symbols are written as their text.
+	std::vector<uint32_t> lengths;
+	for (symbol::id sym : m_symbols)
+	{
+		lengths.push_back(symbol::text(sym).size());
+		header.symbol_text_size += lengths.back();
+	}
+	header.symbol_count = lengths.size();
+
+	static const char padding[8] = {};
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(a.nodes), a.node_count * sizeof(node));
+	out.write(reinterpret_cast<const char*>(a.children), a.child_count * sizeof(node_id));
+	out.write(padding, aligned(a.child_count * sizeof(node_id)) - a.child_count * sizeof(node_id));
+	out.write(a.text, a.text_size);
+	out.write(padding, aligned(a.text_size) - a.text_size);
+	out.write(reinterpret_cast<const char*>(lengths.data()), lengths.size() * sizeof(uint32_t));
+	out.write(padding, aligned(lengths.size() * sizeof(uint32_t)) - lengths.size() * sizeof(uint32_t));
+	for (symbol::id sym : m_symbols)
+	{
+		out.write(symbol::text(sym).data(), symbol::text(sym).size());
+	}
+}
+
+std::optional<tree> tree::view(std::shared_ptr<const void> owner, std::string_view data)
+{
+	tree_header header;
+	if (data.size() < sizeof(header) || reinterpret_cast<uintptr_t>(data.data()) % alignof(node) != 0)
+	{
+		return {};
+	}
+	std::memcpy(&header, data.data(), sizeof(header));
+
+	// Check the sizes one at a time, so that none of them can overflow.
+	size_t left = data.size() - sizeof(header);
+	if (header.node_size != sizeof(node) ||
+		header.node_count > left / sizeof(node) ||
+		header.node_count >= no_node)
+	{
+		return {};
+	}
+	left -= header.node_count * sizeof(node);
+	if (header.child_count > left / sizeof(node_id) ||
+		aligned(header.child_count * sizeof(node_id)) > left)
+	{
+		return {};
+	}
+	left -= aligned(header.child_count * sizeof(node_id));
+	if (header.text_size > left ||
+		aligned(header.text_size) > left)
+	{
+		return {};
+	}
+	left -= aligned(header.text_size);
+	if (header.symbol_count > left / sizeof(uint32_t) ||
+		aligned(header.symbol_count * sizeof(uint32_t)) > left)
+	{
+		return {};
+	}
+	left -= aligned(header.symbol_count * sizeof(uint32_t));
+	if (header.symbol_text_size != left ||
+		(header.root != no_node && header.root >= header.node_count))
+	{
+		return {};
+	}
+
+	tree viewed(header.hash_consed != 0);
+	const char* at	  = data.data() + sizeof(header);
+	viewed.m_owner	  = std::move(owner);
+	viewed.m_root	  = header.root;
+	viewed.m_viewed = {
+		reinterpret_cast<const node*>(at),
+		header.node_count,
+		reinterpret_cast<const node_id*>(at + header.node_count * sizeof(node)),
+		header.child_count,
+		at + header.node_count * sizeof(node) + aligned(header.child_count * sizeof(node_id)),
+		header.text_size
+	};
+
+	// Intern the tree's symbols, which only costs a lookup per distinct symbol.
+	const char* symbols = viewed.m_viewed.text + aligned(header.text_size);
+	const char* text	= symbols + aligned(header.symbol_count * sizeof(uint32_t));
+	size_t text_left	= header.symbol_text_size;
+	for (size_t i = 0; i < header.symbol_count; ++i)
+	{
+		uint32_t length;
+		std::memcpy(&length, symbols + i * sizeof(uint32_t), sizeof(length));
+		if (length > text_left)
+		{
+			return {};
+		}
+		viewed.m_symbols.push_back(symbol::intern(std::string_view(text, length)));
+		text += length;
+		text_left -= length;
+	}
+	if (text_left != 0)
+	{
+		return {};
+	}
+
+	// Every node must be in bounds, and only have children added before it, so that the tree has no cycles.
+	const arrays& a = viewed.m_viewed;
+	for (size_t id = 0; id < a.node_count; ++id)
+	{
+		const node& n = a.nodes[id];
+		if (n.type > kind::expression ||
+			(n.parent != no_node && n.parent >= a.node_count) ||
+			n.first_child > a.child_count || n.child_count > a.child_count - n.first_child ||
+			(interned(n.type) ? n.text_offset >= viewed.m_symbols.size()
+							  : n.text_offset > a.text_size || n.text_length > a.text_size - n.text_offset))
+		{
+			return {};
+		}
+		for (size_t i = 0; i < n.child_count; ++i)
+		{
+			if (a.children[n.first_child + i] >= id)
+			{
+				return {};
+			}
+		}
+	}
+	return viewed;
+}
+
+}
@@ -0,0 +1,341 @@
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include "batch.hpp"
+#include "bytecode.hpp"
+#include "interpreter.hpp"
+#include "jit.hpp"
+#include "optimizer.hpp"
+#include "preprocessor.hpp"
+
+namespace batch
+{
+
+//! SCHEDULING
+
+/// The indices a thread has left, [begin, end). The owner takes from the front, thieves from the back.
+struct share
+{
+	std::mutex lock;
+	size_t begin = 0;
+	size_t end	 = 0;
+};
+
+/// Take the next index from the thread's own share.
+static bool take(share& own, size_t& index)
+{
+	std::lock_guard guard(own.lock);
+	if (own.begin == own.end)
+	{
+		return false;
+	}
+	index = own.begin++;
+	return true;
+}
+
+/// Move the back half of another thread's share into the thread's own, which is empty.
+static bool steal(std::vector<share>& shares, size_t thief)
+{
+	for (size_t offset = 1; offset < shares.size(); ++offset)
+	{
+		share& victim = shares[(thief + offset) % shares.size()];
+		size_t begin, end;
+		{
+			std::lock_guard guard(victim.lock);
+			if (victim.begin == victim.end)
+			{
+				continue;
+			}
+			// Round up, so that a single index left is stolen too.
+			begin		= victim.end - (victim.end - victim.begin + 1) / 2;
+			end			= victim.end;
+			victim.end = begin;
+		}
+
+		std::lock_guard guard(shares[thief].lock);
+		shares[thief].begin = begin;
+		shares[thief].end	= end;
+		return true;
+	}
+	return false;
+}
+
+void for_each(size_t count, size_t threads, const std::function<void(size_t index, size_t worker)>& task)
+{
+	threads = std::max<size_t>(std::min(threads, count), 1);
+	std::vector<share> shares(threads);
+	for (size_t t = 0; t < threads; ++t)
+	{
+		shares[t].begin = count * t / threads;
+		shares[t].end	= count * (t + 1) / threads;
+	}
+
+	std::mutex failure_lock;
+	std::exception_ptr failure;
+	auto work = [&](size_t worker) {
+		try
+		{
+			// Tasks never add more, so once there's nothing left to steal, everything's been taken.
+			for (size_t index;;)
+			{
+				if (take(shares[worker], index))
+				{
+					task(index, worker);
+				}
+				else if (!steal(shares, worker))
+				{
+					break;
+				}
+			}
+		}
+		catch (...)
+		{
+			std::lock_guard guard(failure_lock);
+			if (!failure)
+			{
+				failure = std::current_exception();
+			}
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (size_t t = 1; t < threads; ++t)
+	{
+		pool.emplace_back(work, t);
+	}
+	work(0);
+	for (std::thread& thread : pool)
+	{
+		thread.join();
+	}
+
+	if (failure)
+	{
+		std::rethrow_exception(failure);
+	}
+}
+
+//! FINDING SCRIPTS
+
+/// Name a script's trace after where it is under base, or after its position if it isn't under it.
+static std::string trace_name(const std::filesystem::path& path, const std::filesystem::path& base, size_t position)
+{
+	std::filesystem::path relative = path.lexically_normal().lexically_relative(base.lexically_normal());
+	if (relative.empty() || *relative.begin() == "..")
+	{
+		relative = std::to_string(position) + "-" + path.filename().string();
+	}
+	return relative.string() + ".trace";
+}
+
+std::vector<script> collect(const std::string& path)
+{
+	std::vector<script> scripts;
+	if (std::filesystem::is_directory(path))
+	{
+		for (auto& entry : std::filesystem::recursive_directory_iterator(path))
+		{
+			if (entry.is_regular_file() && entry.path().extension() == ".sl")
+			{
+				scripts.push_back({ entry.path().string(), trace_name(entry.path(), path, scripts.size()) });
+			}
+		}
+		// Directories are listed in no particular order.
+		std::sort(scripts.begin(), scripts.end(), [](const script& a, const script& b) {
+			return a.path < b.path;
+		});
+		return scripts;
+	}
+
+	std::ifstream manifest(path);
+	if (!manifest)
+	{
+		throw std::runtime_error("Could not open " + path + " for reading!");
+	}
+	std::filesystem::path dir = std::filesystem::path(path).parent_path();
+	std::string line;
+	while (std::getline(manifest, line))
+	{
+		// Trim the line, including the carriage return of a manifest written on Windows.
+		size_t begin = line.find_first_not_of(" \t\r");
+		if (begin == std::string::npos || line[begin] == '#')
+		{
+			continue;
+		}
+		line = line.substr(begin, line.find_last_not_of(" \t\r") + 1 - begin);
+
+		std::filesystem::path listed = dir / line;
+		scripts.push_back({ listed.string(), trace_name(listed, dir, scripts.size()) });
+	}
+	return scripts;
+}
+
+//! RUNNING
+
+/// Seconds since the given time.
+static double since(std::chrono::steady_clock::time_point begin)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+/**
+ * @brief Load, parse and run a script in the engine, timing each phase in the result up to
+ * wherever the script stops.
+ *
+ * @return bool Whether it ran to the end. If not, the result has the error.
+ */
+static bool execute(const std::string& path, const options& opts, interpreter::engine& engine, result& res)
+{
+	// The loader owns the files the tokens and the tree view, so it has to last until the script's run.
+	preprocessor::loader loader(opts.cache_dir, 1);
+	uint64_t variant = preprocessor::tree_variant(opts.parse, opts.optimize);
+
+	auto begin	  = std::chrono::steady_clock::now();
+	double* phase = &res.load;
+	auto next	  = [&](double* following) {
+		*phase = since(begin);
+		phase  = following;
+		begin  = std::chrono::steady_clock::now();
+	};
+	try
+	{
+		std::optional<ast::tree> parsed = loader.load_tree(path, variant);
+		res.cached						= parsed.has_value();
+		if (!res.cached)
+		{
+			std::vector<lexer::token> tokens = loader.load(path);
+			if (!tokens.empty() && tokens.back().kind == lexer::token_kind::error)
+			{
+				auto [file, line, column] = loader.locate(tokens.back());
+				throw std::runtime_error("Lexer failed at " + file + ":" + std::to_string(line) + ":" +
+										 std::to_string(column) + ": " + tokens.back().value());
+			}
+
+			next(&res.parse);
+			parsed = parser::parse(tokens, opts.parse);
+			if (opts.optimize)
+			{
+				parsed = optimizer::optimize(*parsed);
+			}
+			loader.store_tree(*parsed, variant);
+		}
+
+		next(&res.run);
+		switch (opts.execute)
+		{
+		case executor::interpret:
+			engine.interpret(*parsed);
+			break;
+		case executor::bytecode:
+			bytecode::run(bytecode::compile(*parsed), engine.state());
+			break;
+		case executor::jit:
+			jit::run(jit::compile(*parsed, engine), *parsed, engine);
+			break;
+		}
+		res.ok = true;
+	}
+	catch (std::exception& e)
+	{
+		res.error = e.what();
+	}
+	*phase = since(begin);
+	return res.ok;
+}
+
+/// Run a single script in a new engine, starting from the prefix's state if there is one, and write its trace.
+static result run_one(const script& s, const options& opts, const interpreter::snapshot* prefix)
+{
+	result res;
+	interpreter::engine engine = prefix != nullptr ? interpreter::engine(*prefix) : interpreter::engine();
+	execute(s.path, opts, engine, res);
+
+	const interpreter::env& state = engine.state();
+	for (interpreter::slot var = 0; var < state.size(); ++var)
+	{
+		res.variables += state.assigned(var);
+	}
+
+	std::filesystem::path trace = std::filesystem::path(opts.output_dir) / s.trace;
+	std::error_code ec;
+	std::filesystem::create_directories(trace.parent_path(), ec);
+	std::ofstream out(trace, std::ios::binary);
+	out << state.trace();
+	if (!res.ok)
+	{
+		out << "Error: " << res.error << "\n";
+	}
+	if (!out)
+	{
+		res.ok = false;
+		res.error += (res.error.empty() ? "" : " ") + std::string("Could not write the trace to ") + trace.string() + ".";
+	}
+	return res;
+}
+
+std::vector<result> run(const std::vector<script>& scripts, const options& opts)
+{
+	// Run the prefix once, and fork its state for every script.
+	std::optional<interpreter::snapshot> prefix;
+	if (!opts.prefix.empty())
+	{
+		interpreter::engine engine;
+		result res;
+		if (!execute(opts.prefix, opts, engine, res))
+		{
+			throw std::runtime_error("The prefix " + opts.prefix + " failed: " + res.error);
+		}
+		prefix.emplace(engine.state());
+	}
+
+	std::vector<result> results(scripts.size());
+	for_each(scripts.size(), opts.jobs, [&](size_t index, size_t worker) {
+		results[index]		  = run_one(scripts[index], opts, prefix ? &*prefix : nullptr);
+		results[index].worker = worker;
+	});
+	return results;
+}
+
+//! REPORTING
+
+void report(std::ostream& out, const std::vector<script>& scripts, const std::vector<result>& results, double elapsed)
+{
+	auto ms = [](double seconds) {
+		std::ostringstream ss;
+		ss << std::fixed << std::setprecision(3) << seconds * 1000;
+		return ss.str();
+	};
+
+	out << "script\tstatus\tvariables\tload_ms\tparse_ms\trun_ms\ttotal_ms\tcached\tworker\terror\n";
+	size_t failed = 0;
+	double busy	  = 0;
+	for (size_t i = 0; i < scripts.size(); ++i)
+	{
+		const result& res = results[i];
+		double total	  = res.load + res.parse + res.run;
+		failed += !res.ok;
+		busy += total;
+
+		// Errors are a single line already, but tabs would split the column.
+		std::string error = res.error;
+		std::replace(error.begin(), error.end(), '\t', ' ');
+		std::replace(error.begin(), error.end(), '\n', ' ');
+		out << scripts[i].path << "\t" << (res.ok ? "ok" : "failed") << "\t" << res.variables << "\t" << ms(res.load) << "\t"
+			<< ms(res.parse) << "\t" << ms(res.run) << "\t" << ms(total) << "\t" << (res.cached ? "yes" : "no") << "\t"
+			<< res.worker << "\t" << error << "\n";
+	}
+
+	out << "\n# " << scripts.size() << " scripts, " << failed << " failed, in " << ms(elapsed) << " ms ("
+		<< std::fixed << std::setprecision(1) << scripts.size() / std::max(elapsed, 1e-9) << " scripts/s), "
+		<< ms(busy) << " ms spent in scripts.\n";
+}
+
+}
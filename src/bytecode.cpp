@@ -0,0 +1,339 @@
+#include "bytecode.hpp"
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include "evaluate.hpp"
+
+#if defined(__GNUC__)
+// Jump straight from each instruction to the next one's handler, instead of back through a switch.
+#define VM_COMPUTED_GOTO
+#endif
+
+using ast::kind;
+using ast::node_id;
+using interpreter::env;
+using interpreter::variable;
+
+namespace bytecode
+{
+
+//! COMPILER
+
+/// Lowers the tree a statement at a time, mirroring what `eval` does with each node.
+class compiler
+{
+public:
+	compiler(const ast::tree& code)
+		: m_code(code), m_depth(0), m_empty(no_constant)
+	{
+		// Number every name in the order its nodes are in, as resolving does, so that running gives new
+		// variables slots in the same order as interpreting the tree.
+		for (node_id node = 0; node < m_code.size(); ++node)
+		{
+			if (m_code.type(node) == kind::identifier)
+			{
+				name(m_code.symbol(node));
+			}
+		}
+	}
+
+	void statement(node_id node)
+	{
+		// Only assignments do anything.
+		if (m_code.type(node) != kind::assignment)
+		{
+			return;
+		}
+
+		node_id lhs = m_code.children(node).at(0);
+		node_id rhs = m_code.children(node).at(2);
+		if (m_code.type(lhs) != kind::identifier) throw std::runtime_error("Invalid syntax in assignment.");
+
+		switch (m_code.type(rhs))
+		{
+		case kind::identifier:
+			emit(opcode::load_var, name(m_code.symbol(rhs)), 1);
+			break;
+		case kind::expression:
+			expression(rhs);
+			break;
+		default:
+			literal(rhs);
+		}
+		emit(opcode::store, name(m_code.symbol(lhs)), -1);
+	}
+
+	program finish()
+	{
+		emit(opcode::halt, 0, 0);
+		std::vector<uint8_t> stored(m_program.names.size());
+		for (const instruction& ins : m_program.code)
+		{
+			if (ins.op == opcode::store && !stored[ins.arg])
+			{
+				stored[ins.arg] = true;
+				m_program.stored.push_back(ins.arg);
+			}
+		}
+		return std::move(m_program);
+	}
+
+private:
+	void expression(node_id node)
+	{
+		for (node_id child : m_code.children(node))
+		{
+			if (m_code.type(child) == kind::arithmetic)
+			{
+				arithmetic(child);
+				return;
+			}
+		}
+		if (m_empty == no_constant)
+		{
+			m_empty = m_program.constants.size();
+			m_program.constants.push_back(variable());
+		}
+		emit(opcode::load_const, m_empty, 1);
+	}
+
+	void arithmetic(node_id node)
+	{
+		operand(m_code.children(node).at(0));
+		operand(m_code.children(node).at(2));
+		emit(opcode::binary, oper(m_code.text(m_code.children(node).at(1))), -1);
+	}
+
+	void operand(node_id node)
+	{
+		switch (m_code.type(node))
+		{
+		case kind::identifier:
+			emit(opcode::load_operand, name(m_code.symbol(node)), 1);
+			break;
+		case kind::expression:
+			expression(node);
+			break;
+		case kind::arithmetic:
+			arithmetic(node);
+			break;
+		default:
+			literal(node);
+		}
+	}
+
+	void literal(node_id node)
+	{
+		// Interned literals are told apart by their symbols, the rest by their text.
+		symbol::id sym = m_code.symbol(node);
+		uint32_t next  = m_program.constants.size();
+		uint32_t index = sym != symbol::none
+							 ? m_interned.try_emplace(sym, next).first->second
+							 : m_literals[static_cast<size_t>(m_code.type(node))].try_emplace(m_code.stored_text(node), next).first->second;
+		if (index == next)
+		{
+			m_program.constants.push_back(variable(m_code, node));
+		}
+		emit(opcode::load_const, index, 1);
+	}
+
+	/// The variable's number in the program.
+	uint32_t name(symbol::id name)
+	{
+		auto [found, added] = m_names.try_emplace(name, m_program.names.size());
+		if (added)
+		{
+			m_program.names.push_back(name);
+		}
+		return found->second;
+	}
+
+	uint32_t oper(std::string_view oper)
+	{
+		auto [found, added] = m_operators.try_emplace(oper, m_program.operators.size());
+		if (added)
+		{
+			m_program.operators.emplace_back(oper);
+		}
+		return found->second;
+	}
+
+	/// Add an instruction, which changes how many values are on the stack by the given amount.
+	void emit(opcode op, uint32_t arg, int stack_effect)
+	{
+		m_program.code.push_back({ op, arg });
+		m_depth += stack_effect;
+		m_program.max_stack = std::max(m_program.max_stack, m_depth);
+	}
+
+	static constexpr uint32_t no_constant = std::numeric_limits<uint32_t>::max();
+
+	const ast::tree& m_code;
+	program m_program;
+	size_t m_depth;
+	/// Literal constants by kind and text, which view into the tree.
+	std::unordered_map<std::string_view, uint32_t> m_literals[static_cast<size_t>(kind::expression) + 1];
+	/// Interned literal constants by symbol.
+	std::unordered_map<symbol::id, uint32_t> m_interned;
+	/// The empty constant, if there is one yet.
+	uint32_t m_empty;
+	std::unordered_map<symbol::id, uint32_t> m_names;
+	std::unordered_map<std::string_view, uint32_t> m_operators;
+};
+
+program compile(const ast::tree& code)
+{
+	auto children = code.children(code.root());
+	return compile(code, std::vector<node_id>(children.begin(), children.end()));
+}
+
+program compile(const ast::tree& code, const std::vector<node_id>& statements)
+{
+	compiler c(code);
+	for (node_id statement : statements)
+	{
+		c.statement(statement);
+	}
+	return c.finish();
+}
+
+//! VIRTUAL MACHINE
+
+void run(const program& code, env& state)
+{
+	// Copy each of the program's variables out of the state, once, so that the program indexes them directly.
+	std::vector<interpreter::slot> slots;
+	std::vector<variable> locals(code.names.size());
+	std::vector<uint8_t> defined(code.names.size());
+	for (size_t var = 0; var < code.names.size(); ++var)
+	{
+		slots.push_back(state.resolve(code.names[var]));
+		if (state.assigned(slots[var]))
+		{
+			locals[var]	 = state.value(slots[var]);
+			defined[var] = true;
+		}
+	}
+	// Whatever's been stored by the end, even if that's a throw, goes back into the state.
+	auto write_back = [&] {
+		for (uint32_t var : code.stored)
+		{
+			if (defined[var])
+			{
+				state.assign(slots[var], locals[var]);
+			}
+		}
+	};
+
+	std::vector<variable> stack(code.max_stack);
+	// One past the top of the stack.
+	variable* top			  = stack.data();
+	const instruction* ip	  = code.code.data();
+	const variable* constants = code.constants.data();
+	variable* values		  = locals.data();
+	uint8_t* assigned		  = defined.data();
+
+	try
+	{
+#ifdef VM_COMPUTED_GOTO
+		// In the order of the opcodes.
+		static const void* handlers[] = {
+			&&vm_load_const,
+			&&vm_load_var,
+			&&vm_load_operand,
+			&&vm_binary,
+			&&vm_store,
+			&&vm_halt,
+		};
+#define VM_CASE(name) vm_##name
+#define VM_NEXT() goto* handlers[static_cast<size_t>((++ip)->op)]
+		goto* handlers[static_cast<size_t>(ip->op)];
+#else
+#define VM_CASE(name) case opcode::name
+#define VM_NEXT() \
+	++ip;         \
+	goto dispatch
+	dispatch:
+		switch (ip->op)
+		{
+#endif
+
+		VM_CASE(load_const):
+		{
+			*top++ = constants[ip->arg];
+			VM_NEXT();
+		}
+		VM_CASE(load_var):
+		{
+			if (!assigned[ip->arg])
+			{
+				throw std::runtime_error("Identifier " + std::string(symbol::text(code.names[ip->arg])) + " undefined.");
+			}
+			*top++ = values[ip->arg];
+			VM_NEXT();
+		}
+		VM_CASE(load_operand):
+		{
+			*top++ = assigned[ip->arg] ? values[ip->arg] : variable();
+			VM_NEXT();
+		}
+		VM_CASE(binary):
+		{
+			--top;
+			top[-1] = eval::binary(top[-1], code.operators[ip->arg], top[0]);
+			VM_NEXT();
+		}
+		VM_CASE(store):
+		{
+			values[ip->arg]	  = *--top;
+			assigned[ip->arg] = true;
+			VM_NEXT();
+		}
+		VM_CASE(halt):
+		{
+			write_back();
+			return;
+		}
+
+#ifndef VM_COMPUTED_GOTO
+		}
+#endif
+	}
+	catch (...)
+	{
+		write_back();
+		throw;
+	}
+#undef VM_CASE
+#undef VM_NEXT
+}
+
+std::string str(const program& code)
+{
+	static const char* opcode_names[] = { "load_const", "load_var", "load_operand", "binary", "store", "halt" };
+
+	std::ostringstream ss;
+	for (size_t i = 0; i < code.code.size(); ++i)
+	{
+		const instruction& ins = code.code[i];
+		ss << i << ": " << opcode_names[static_cast<size_t>(ins.op)];
+		switch (ins.op)
+		{
+		case opcode::load_const:
+			ss << " " << code.constants[ins.arg].type() << " " << code.constants[ins.arg].value();
+			break;
+		case opcode::binary:
+			ss << " " << code.operators[ins.arg];
+			break;
+		case opcode::halt:
+			break;
+		default:
+			ss << " " << symbol::text(code.names[ins.arg]);
+		}
+		ss << "\n";
+	}
+	return ss.str();
+}
+
+}
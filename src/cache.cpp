@@ -0,0 +1,358 @@
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include "cache.hpp"
+#include "source.hpp"
+
+namespace cache
+{
+
+std::string default_directory()
+{
+	if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg != nullptr && *xdg != '\0')
+	{
+		return std::string(xdg) + "/slang";
+	}
+	if (const char* home = std::getenv("HOME"); home != nullptr && *home != '\0')
+	{
+		return std::string(home) + "/.cache/slang";
+	}
+	return ".slang-cache";
+}
+
+//! HASHING
+
+/// MurmurHash64A's constants.
+static constexpr uint64_t multiplier = 0xc6a4a7935bd1e995ULL;
+static constexpr int shift			 = 47;
+
+hasher::hasher()
+	: m_hash(0x8445d61a4e774912ULL), m_size(0), m_tail(0), m_tail_size(0)
+{
+}
+
+void hasher::mix(uint64_t word)
+{
+	word *= multiplier;
+	word ^= word >> shift;
+	word *= multiplier;
+	m_hash ^= word;
+	m_hash *= multiplier;
+}
+
+void hasher::update(std::string_view data)
+{
+	m_size += data.size();
+
+	size_t i = 0;
+	// Top up the leftover bytes from the last piece first.
+	for (; m_tail_size != 0 && i < data.size(); ++i)
+	{
+		m_tail |= uint64_t(static_cast<unsigned char>(data[i])) << (8 * m_tail_size);
+		if (++m_tail_size == 8)
+		{
+			mix(m_tail);
+			m_tail		= 0;
+			m_tail_size = 0;
+		}
+	}
+
+	for (; i + 8 <= data.size(); i += 8)
+	{
+		uint64_t word;
+		std::memcpy(&word, data.data() + i, 8);
+		mix(word);
+	}
+
+	for (; i < data.size(); ++i)
+	{
+		m_tail |= uint64_t(static_cast<unsigned char>(data[i])) << (8 * m_tail_size++);
+	}
+}
+
+uint64_t hasher::digest() const
+{
+	uint64_t h = m_hash ^ (m_size * multiplier);
+	if (m_tail_size != 0)
+	{
+		h ^= m_tail;
+		h *= multiplier;
+	}
+	h ^= h >> shift;
+	h *= multiplier;
+	h ^= h >> shift;
+	return h;
+}
+
+//! TOKENS
+
+/**
+ * @brief The header of a cached token file.
+ * 
+ */
+struct token_header
+{
+	char magic[4];
+	uint32_t version;
+	/// The size of the code the tokens were lexed from.
+	uint64_t size;
+	/// The amount of tokens.
+	uint64_t count;
+};
+
+/**
+ * @brief A cached token, as an offset into the code.
+ * 
+ */
+struct token_entry
+{
+	uint64_t offset;
+	uint32_t length;
+	uint8_t kind;
+	uint8_t stripped;
+};
+
+static constexpr char token_magic[4] = { 'S', 'L', 'T', 'K' };
+
+/// Get the path of the cache entry with the given key.
+std::string entry_path(const std::string& dir, uint64_t key, const char* extension)
+{
+	std::ostringstream ss;
+	ss << dir << "/" << std::hex << key << extension;
+	return ss.str();
+}
+
+std::optional<std::vector<lexer::token>> load_tokens(const std::string& dir, uint64_t key, std::string_view code)
+{
+	std::ifstream file(entry_path(dir, key, ".tokens"), std::ios::binary);
+	if (!file)
+	{
+		return {};
+	}
+
+	token_header header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		std::memcmp(header.magic, token_magic, sizeof(token_magic)) != 0 ||
+		header.version != version ||
+		header.size != code.size() ||
+		header.count > code.size() + 1)
+	{
+		return {};
+	}
+
+	std::vector<token_entry> entries(header.count);
+	if (!file.read(reinterpret_cast<char*>(entries.data()), entries.size() * sizeof(token_entry)))
+	{
+		return {};
+	}
+
+	std::vector<lexer::token> tokens;
+	tokens.reserve(entries.size());
+	for (auto& entry : entries)
+	{
+		if (entry.offset > code.size() ||
+			entry.length > code.size() - entry.offset ||
+			entry.kind > static_cast<uint8_t>(lexer::token_kind::error))
+		{
+			return {};
+		}
+
+		auto kind = static_cast<lexer::token_kind>(entry.kind);
+		// Errors view all the remaining code, which may not fit in the length.
+		size_t length = kind == lexer::token_kind::error ? std::string_view::npos : entry.length;
+		tokens.push_back({ kind, entry.stripped != 0, code.substr(entry.offset, length) });
+	}
+	return tokens;
+}
+
+/**
+ * @brief Write a cache entry to a temporary file, and rename it into place, so nothing ever reads a half-written entry.
+ * 
+ * @param dir The cache directory, created if needed.
+ * @param path The cache entry's path.
+ * @param write Writes the entry's contents.
+ */
+void write_entry(const std::string& dir, const std::string& path, const std::function<void(std::ostream&)>& write)
+{
+	std::error_code ec;
+	std::filesystem::create_directories(dir, ec);
+
+	std::string temp = path + "." + std::to_string(::getpid()) + "." +
+					   std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+	{
+		std::ofstream file(temp, std::ios::binary);
+		if (!file)
+		{
+			return;
+		}
+		write(file);
+		if (!file)
+		{
+			std::filesystem::remove(temp, ec);
+			return;
+		}
+	}
+	std::filesystem::rename(temp, path, ec);
+}
+
+void store_tokens(const std::string& dir, uint64_t key, std::string_view code, const std::vector<lexer::token>& tokens)
+{
+	write_entry(dir, entry_path(dir, key, ".tokens"), [&](std::ostream& file) {
+		token_header header = { {}, version, code.size(), tokens.size() };
+		std::memcpy(header.magic, token_magic, sizeof(token_magic));
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		for (auto& tok : tokens)
+		{
+			// Zeroed, so the padding is too.
+			token_entry entry;
+			std::memset(&entry, 0, sizeof(entry));
+			entry.offset   = tok.text.data() - code.data();
+			entry.length   = static_cast<uint32_t>(tok.text.size());
+			entry.kind	   = static_cast<uint8_t>(tok.kind);
+			entry.stripped = tok.stripped;
+			file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+		}
+	});
+}
+
+//! PARSE TREES
+
+/**
+ * @brief The header of a cached parse tree file. It's followed by the dependencies,
+ * padded to 8 bytes, and then the tree as ast::tree::write lays it out.
+ * 
+ */
+struct tree_header
+{
+	char magic[4];
+	uint32_t version;
+	/// The size of the dependencies, in bytes, before padding.
+	uint64_t dependencies_size;
+};
+
+static constexpr char tree_magic[4] = { 'S', 'L', 'A', 'S' };
+
+/// Append a length-prefixed string.
+static void write_string(std::ostream& out, std::string_view str)
+{
+	uint32_t size = static_cast<uint32_t>(str.size());
+	out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+	out.write(str.data(), str.size());
+}
+
+/// Read a plain value off the front of data, if there's enough of it.
+template <typename T>
+static bool read_value(std::string_view& data, T& value)
+{
+	if (data.size() < sizeof(T))
+	{
+		return false;
+	}
+	std::memcpy(&value, data.data(), sizeof(T));
+	data.remove_prefix(sizeof(T));
+	return true;
+}
+
+/// Read a length-prefixed string off the front of data.
+static bool read_string(std::string_view& data, std::string& str)
+{
+	uint32_t size;
+	if (!read_value(data, size) || data.size() < size)
+	{
+		return false;
+	}
+	str.assign(data.data(), size);
+	data.remove_prefix(size);
+	return true;
+}
+
+std::optional<cached_tree> load_tree(const std::string& dir, uint64_t key)
+{
+	auto file = std::make_shared<source>(entry_path(dir, key, ".ast"));
+	if (!*file)
+	{
+		return {};
+	}
+
+	std::string_view data = file->view();
+	tree_header header;
+	if (!read_value(data, header) ||
+		std::memcmp(header.magic, tree_magic, sizeof(tree_magic)) != 0 ||
+		header.version != tree_version ||
+		header.dependencies_size > data.size())
+	{
+		return {};
+	}
+
+	std::vector<dependency> dependencies;
+	std::string_view table = data.substr(0, header.dependencies_size);
+	while (!table.empty())
+	{
+		dependency dep;
+		uint32_t import_count;
+		if (!read_string(table, dep.path) || !read_value(table, dep.hash) || !read_value(table, import_count))
+		{
+			return {};
+		}
+		for (uint32_t i = 0; i < import_count; ++i)
+		{
+			std::pair<std::string, std::string> import;
+			if (!read_string(table, import.first) || !read_string(table, import.second))
+			{
+				return {};
+			}
+			dep.imports.push_back(std::move(import));
+		}
+		dependencies.push_back(std::move(dep));
+	}
+
+	size_t padded = (header.dependencies_size + 7) & ~size_t(7);
+	if (padded > data.size())
+	{
+		return {};
+	}
+	auto tree = ast::tree::view(file, data.substr(padded));
+	if (!tree.has_value())
+	{
+		return {};
+	}
+	return cached_tree{ std::move(*tree), std::move(dependencies) };
+}
+
+void store_tree(const std::string& dir, uint64_t key, const std::vector<dependency>& dependencies, const ast::tree& tree)
+{
+	std::ostringstream table;
+	for (auto& dep : dependencies)
+	{
+		write_string(table, dep.path);
+		table.write(reinterpret_cast<const char*>(&dep.hash), sizeof(dep.hash));
+		uint32_t import_count = static_cast<uint32_t>(dep.imports.size());
+		table.write(reinterpret_cast<const char*>(&import_count), sizeof(import_count));
+		for (auto& [imported, canonical] : dep.imports)
+		{
+			write_string(table, imported);
+			write_string(table, canonical);
+		}
+	}
+	std::string dependencies_data = table.str();
+
+	write_entry(dir, entry_path(dir, key, ".ast"), [&](std::ostream& file) {
+		tree_header header = { {}, tree_version, dependencies_data.size() };
+		std::memcpy(header.magic, tree_magic, sizeof(tree_magic));
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(dependencies_data.data(), dependencies_data.size());
+
+		// The tree's arrays must be aligned once mapped.
+		static const char padding[8] = {};
+		file.write(padding, ((dependencies_data.size() + 7) & ~size_t(7)) - dependencies_data.size());
+		tree.write(file);
+	});
+}
+
+}
\ No newline at end of file
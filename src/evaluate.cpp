@@ -1,79 +1,97 @@
 #include "evaluate.hpp"
+#include <optional>
+#include <stdexcept>
 
+using ast::kind;
+using ast::node_id;
 using interpreter::env;
+using interpreter::slot_table;
 using interpreter::variable;
-using parser::tree_node;
 
 namespace eval
 {
 
 std::optional<variable> get_variable(env& state, std::string name)
 {
-	try
+	if (const variable* var = state.find(name))
 	{
-		return state.vars.at("name");
-	}
-	catch (std::out_of_range e)
-	{
-		return {};
+		return *var;
 	}
+	return {};
 }
 
-void assignment(env& state, const tree_node& node)
+void assignment(env& state, const ast::tree& code, const slot_table& slots, node_id node)
 {
-	tree_node lhs = node.at(0);
-	tree_node rhs = node.at(2);
+	node_id lhs = code.children(node).at(0);
+	node_id rhs = code.children(node).at(2);
 
-	if (lhs.type() != "identifier") throw std::runtime_error("Invalid syntax in assignment.");
+	if (code.type(lhs) != kind::identifier) throw std::runtime_error("Invalid syntax in assignment.");
 
-	if (rhs.type() == "identifier")
+	variable value;
+	if (code.type(rhs) == kind::identifier)
 	{
-		auto var = state.vars.find(rhs.value());
-		if (var == state.vars.end())
+		interpreter::slot var = slots[rhs];
+		if (!state.assigned(var))
 		{
-			throw std::runtime_error("Identifier " + rhs.value() + " undefined.");
+			throw std::runtime_error("Identifier " + code.value(rhs) + " undefined.");
 		}
-		state.vars[lhs.value()] = state.vars[rhs.value()];
+		value = state.value(var);
 	}
-	else if (rhs.type() == "expression")
+	else if (code.type(rhs) == kind::expression)
 	{
-		state.vars[lhs.value()] = expression(state, rhs);
+		value = expression(state, code, slots, rhs);
 	}
 	else
 	{
-		state.vars[lhs.value()].val  = rhs.value();
-		state.vars[lhs.value()].type = rhs.type();
+		value = variable(code, rhs);
 	}
+
+	state.assign(slots[lhs], value);
 }
 
-variable expression(env& state, const tree_node& node)
+variable expression(env& state, const ast::tree& code, const slot_table& slots, node_id node)
 {
 	variable ret;
 
-	std::optional<tree_node> math_node =
-		node.find_child([](const parser::tree_node& n) -> bool {
-			return n.type() == "arithmetic";
-		});
-	if (math_node.has_value())
+	for (node_id child : code.children(node))
 	{
-		ret = arithmetic(state, math_node.value());
+		if (code.type(child) == kind::arithmetic)
+		{
+			ret = arithmetic(state, code, slots, child);
+			break;
+		}
 	}
 
 	return ret;
 }
 
-variable arithmetic(interpreter::env& state, const parser::tree_node& node)
+variable arithmetic(env& state, const ast::tree& code, const slot_table& slots, node_id node)
 {
-	tree_node lhs  = node.at(0);
-	tree_node oper = node.at(1);
-	tree_node rhs  = node.at(2);
+	node_id lhs  = code.children(node).at(0);
+	node_id oper = code.children(node).at(1);
+	node_id rhs  = code.children(node).at(2);
 
-	variable ret;
+	return binary(operand(state, code, slots, lhs), code.text(oper), operand(state, code, slots, rhs));
+}
 
-	ret.type = "number";
-	ret.val  = "5";
+variable operand(env& state, const ast::tree& code, const slot_table& slots, node_id node)
+{
+	switch (code.type(node))
+	{
+	case kind::identifier:
+		return state.assigned(slots[node]) ? state.value(slots[node]) : variable();
+	case kind::expression:
+		return expression(state, code, slots, node);
+	case kind::arithmetic:
+		return arithmetic(state, code, slots, node);
+	default:
+		return variable(code, node);
+	}
+}
 
-	return ret;
+variable binary(const variable& lhs, std::string_view oper, const variable& rhs)
+{
+	return variable::integer(5);
 }
 
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <sstream>
 #include <unordered_map>
 #include "evaluate.hpp"
 #include "interpreter.hpp"
@@ -6,20 +7,143 @@
 namespace interpreter
 {
 
-/// The singleton persistent state.
-env state = env();
+slot env::resolve(symbol::id name)
+{
+	m_slots.grow(name + 1, no_slot);
+	if (m_slots[name] != no_slot)
+	{
+		return m_slots[name];
+	}
+
+	slot added			= m_names.size();
+	m_slots.write(name) = added;
+	m_names.push_back(name);
+	m_values.push_back(variable());
+	m_assigned.push_back(false);
+	return added;
+}
+
+slot env::resolve(std::string_view name)
+{
+	return resolve(symbol::intern(name));
+}
+
+const variable* env::find(std::string_view name) const
+{
+	symbol::id sym = symbol::find(name);
+	if (sym >= m_slots.size() || m_slots[sym] == no_slot || !m_assigned[m_slots[sym]])
+	{
+		return nullptr;
+	}
+	return &m_values[m_slots[sym]];
+}
+
+size_t env::size() const
+{
+	return m_names.size();
+}
 
-env interpret(parser::tree_node& code)
+std::string env::trace() const
 {
-	for (auto& node : code.children())
+	std::ostringstream ss;
+	for (slot var = 0; var < size(); ++var)
 	{
-		if (node.type() == "assignment")
+		if (m_assigned[var])
 		{
-			eval::assignment(state, node);
+			ss << symbol::text(m_names[var]) << ": " << m_values[var].type() << " = " << m_values[var].value() << std::endl;
 		}
 	}
+	return ss.str();
+}
+
+env env::fork()
+{
+	env copy;
+	copy.m_values	= m_values.fork();
+	copy.m_assigned = m_assigned.fork();
+	copy.m_names	= m_names.fork();
+	copy.m_slots	= m_slots.fork();
+	return copy;
+}
+
+env env::share() const
+{
+	env copy;
+	copy.m_values	= m_values.share();
+	copy.m_assigned = m_assigned.share();
+	copy.m_names	= m_names.share();
+	copy.m_slots	= m_slots.share();
+	return copy;
+}
+
+size_t env::unshared_bytes() const
+{
+	return m_values.unshared_bytes() + m_assigned.unshared_bytes() + m_names.unshared_bytes() + m_slots.unshared_bytes();
+}
+
+snapshot::snapshot(env& state)
+	: m_state(state.fork())
+{
+}
+
+env snapshot::fork() const
+{
+	// The snapshot's own state is a fork nothing writes to, so sharing it leaves it untouched.
+	return m_state.share();
+}
+
+const env& snapshot::state() const
+{
+	return m_state;
+}
+
+engine::engine(const snapshot& start)
+	: m_state(start.fork())
+{
+}
+
+void engine::resolve(const ast::tree& code, slot_table& slots)
+{
+	// Only reserve up front, since reserving exactly for every line of a session would copy the table each time.
+	if (slots.empty())
+	{
+		slots.reserve(code.size());
+	}
+	for (ast::node_id node = slots.size(); node < code.size(); ++node)
+	{
+		slots.push_back(code.type(node) == ast::kind::identifier ? m_state.resolve(code.symbol(node)) : no_slot);
+	}
+}
 
-	return state;
+void engine::execute(const ast::tree& code, const slot_table& slots, ast::node_id statement)
+{
+	if (code.type(statement) == ast::kind::assignment)
+	{
+		eval::assignment(m_state, code, slots, statement);
+	}
+}
+
+const env& engine::interpret(const ast::tree& code)
+{
+	slot_table slots;
+	resolve(code, slots);
+
+	for (ast::node_id node : code.children(code.root()))
+	{
+		execute(code, slots, node);
+	}
+
+	return m_state;
 }
 
-}
\ No newline at end of file
+env& engine::state()
+{
+	return m_state;
+}
+
+const env& engine::state() const
+{
+	return m_state;
+}
+
+}
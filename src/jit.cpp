@@ -0,0 +1,743 @@
+#include "jit.hpp"
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <initializer_list>
+#include <new>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include "evaluate.hpp"
+
+#if defined(__x86_64__) && defined(__linux__)
+// Native code can be generated and mapped executable.
+#define JIT_NATIVE
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using ast::kind;
+using ast::node_id;
+using interpreter::slot;
+using interpreter::variable;
+
+namespace jit
+{
+
+bool supported()
+{
+#ifdef JIT_NATIVE
+	return true;
+#else
+	return false;
+#endif
+}
+
+/// A block's function. Returns how many of the block's statements it ran.
+using native_function = uint32_t (*)(variable* values, uint8_t* assigned, variable* scratch, const variable* constants,
+									 const std::string* operators);
+
+/// Slots, temporaries and constants are addressed with 32-bit displacements, so there can't be more than this many.
+static constexpr size_t max_index = 1 << 27;
+
+/// Jumps reach 2GB either way, so a program's code can't be any bigger.
+static constexpr size_t max_code = size_t(1) << 31;
+
+//! CALLS FROM NATIVE CODE
+
+/// What the operator threw while native code was running, which is rethrown once it's returned.
+static thread_local std::exception_ptr failure;
+
+/**
+ * @brief Apply an operator for native code, replacing the left operand with the result.
+ *
+ * @remarks Exceptions can't unwind through native code, so they're kept for later.
+ */
+static bool apply(variable* operands, uint32_t oper, const std::string* operators) noexcept
+{
+	try
+	{
+		operands[0] = eval::binary(operands[0], operators[oper], operands[1]);
+		return true;
+	}
+	catch (...)
+	{
+		failure = std::current_exception();
+		return false;
+	}
+}
+
+//! ASSEMBLER
+
+enum reg : uint8_t
+{
+	rax = 0,
+	rcx = 1,
+	rdx = 2,
+	rbx = 3,
+	rbp = 5,
+	rsi = 6,
+	rdi = 7,
+	r8	= 8,
+	r12 = 12,
+	r13 = 13,
+	r14 = 14,
+	r15 = 15
+};
+
+/// The registers the native function's arguments are kept in, which calls leave alone.
+static constexpr reg values_reg = rbx, assigned_reg = r12, scratch_reg = r13, constants_reg = r14, operators_reg = r15;
+/// Holds the address of apply(), so that calling it is short.
+static constexpr reg apply_reg = rbp;
+
+/// Condition codes, for conditional jumps.
+enum condition : uint8_t
+{
+	equal	  = 0x4,
+	not_equal = 0x5
+};
+
+/**
+ * @brief Encodes the few x86-64 instructions the compiler needs, straight into memory
+ * that's made executable once the code's done.
+ *
+ * @remarks Address space for the most code there can be is reserved up front, and pages
+ * are added to it as the code grows, so the code's never moved or copied.
+ */
+class assembler
+{
+public:
+	assembler()
+		: m_code(nullptr), m_size(0), m_capacity(0)
+	{
+	}
+
+	assembler(const assembler&) = delete;
+	assembler& operator=(const assembler&) = delete;
+
+	~assembler()
+	{
+#ifdef JIT_NATIVE
+		if (m_code != nullptr)
+		{
+			::munmap(m_code, max_code);
+		}
+#endif
+	}
+
+	size_t size() const
+	{
+		return m_size;
+	}
+
+	/// Make room for about this much code up front.
+	void reserve(size_t size)
+	{
+		room(size);
+	}
+
+	/**
+	 * @brief Make the code executable, and hand it over.
+	 *
+	 * @return std::shared_ptr<const uint8_t> The code, or null if it can't be made executable.
+	 */
+	std::shared_ptr<const uint8_t> finish()
+	{
+#ifdef JIT_NATIVE
+		// The code's never writable and executable at once.
+		if (m_code == nullptr || ::mprotect(m_code, m_capacity, PROT_READ | PROT_EXEC) != 0)
+		{
+			return nullptr;
+		}
+		// Give back the address space the code didn't need.
+		::munmap(m_code + m_capacity, max_code - m_capacity);
+		size_t capacity = m_capacity;
+		uint8_t* code	= std::exchange(m_code, nullptr);
+		return std::shared_ptr<const uint8_t>(code, [capacity](const uint8_t* code) {
+			::munmap(const_cast<uint8_t*>(code), capacity);
+		});
+#else
+		return nullptr;
+#endif
+	}
+
+	void bytes(std::initializer_list<uint8_t> bytes)
+	{
+		std::memcpy(room(bytes.size()), bytes.begin(), bytes.size());
+		m_size += bytes.size();
+	}
+
+	/// movups xmm0, [base + disp]
+	void load(reg base, int32_t disp)
+	{
+		memory(false, { 0x0F, 0x10 }, 0, base, disp);
+	}
+
+	/// movups [base + disp], xmm0
+	void store(reg base, int32_t disp)
+	{
+		memory(false, { 0x0F, 0x11 }, 0, base, disp);
+	}
+
+	/// lea to, [base + disp]
+	void address(reg to, reg base, int32_t disp)
+	{
+		memory(true, { 0x8D }, to, base, disp);
+	}
+
+	/// mov byte [base + disp], value
+	void set_byte(reg base, int32_t disp, uint8_t value)
+	{
+		memory(false, { 0xC6 }, 0, base, disp);
+		bytes({ value });
+	}
+
+	/// cmp byte [base + disp], 0
+	void test_byte(reg base, int32_t disp)
+	{
+		memory(false, { 0x80 }, 7, base, disp);
+		bytes({ 0 });
+	}
+
+	/// mov to, value
+	void move(reg to, uint64_t value)
+	{
+		bytes({ static_cast<uint8_t>(0x48 | (to >> 3)), static_cast<uint8_t>(0xB8 | (to & 7)) });
+		integer(value);
+	}
+
+	/// mov to, value, for the low registers only.
+	void move32(reg to, uint32_t value)
+	{
+		bytes({ static_cast<uint8_t>(0xB8 | to) });
+		integer(value);
+	}
+
+	/// mov to, from
+	void copy(reg to, reg from)
+	{
+		bytes({ static_cast<uint8_t>(0x48 | (from >> 3) << 2 | (to >> 3)), 0x89,
+				static_cast<uint8_t>(0xC0 | (from & 7) << 3 | (to & 7)) });
+	}
+
+	/// call target, for the low registers only.
+	void call(reg target)
+	{
+		bytes({ 0xFF, static_cast<uint8_t>(0xD0 | target) });
+	}
+
+	/// jmp to the position in the code.
+	void jump(size_t target)
+	{
+		bytes({ 0xE9 });
+		integer(static_cast<int32_t>(target - (m_size + 4)));
+	}
+
+	/**
+	 * @brief A short jump forward if the condition holds.
+	 *
+	 * @return size_t Where the jump's from, to pass to land() once the target's reached.
+	 */
+	size_t jump_if(condition when)
+	{
+		bytes({ static_cast<uint8_t>(0x70 | when), 0 });
+		return m_size;
+	}
+
+	/// Make the short jump from the position land here.
+	void land(size_t from)
+	{
+		m_code[from - 1] = static_cast<uint8_t>(m_size - from);
+	}
+
+	/// A jump anywhere if the condition holds. Its target is set by land_far().
+	size_t jump_far_if(condition when)
+	{
+		bytes({ 0x0F, static_cast<uint8_t>(0x80 | when) });
+		integer<int32_t>(0);
+		return m_size;
+	}
+
+	void land_far(size_t from)
+	{
+		int32_t offset = static_cast<int32_t>(m_size - from);
+		std::memcpy(m_code + from - 4, &offset, sizeof(offset));
+	}
+
+private:
+	/// An instruction on [base + disp], with the field in the ModRM byte's reg field.
+	void memory(bool wide, std::initializer_list<uint8_t> opcode, uint8_t field, uint8_t base, int32_t disp)
+	{
+		// No instruction's longer than this.
+		uint8_t* at = room(16);
+		uint8_t* begin = at;
+
+		uint8_t rex = (wide ? 0x48 : 0x40) | (field >> 3) << 2 | (base >> 3);
+		if (rex != 0x40)
+		{
+			*at++ = rex;
+		}
+		for (uint8_t op : opcode)
+		{
+			*at++ = op;
+		}
+		// Displacements that fit in a byte take one, instead of four.
+		bool small = disp >= -128 && disp < 128;
+		*at++	   = (small ? 0x40 : 0x80) | (field & 7) << 3 | (base & 7);
+		// rsp and r12 as bases need a SIB byte.
+		if ((base & 7) == 4)
+		{
+			*at++ = 0x24;
+		}
+		if (small)
+		{
+			*at++ = static_cast<uint8_t>(disp);
+		}
+		else
+		{
+			std::memcpy(at, &disp, sizeof(disp));
+			at += sizeof(disp);
+		}
+		m_size += at - begin;
+	}
+
+	template <typename T>
+	void integer(T value)
+	{
+		std::memcpy(room(sizeof(T)), &value, sizeof(T));
+		m_size += sizeof(T);
+	}
+
+	/// Where the next bytes go, after growing the memory if they don't fit.
+	uint8_t* room(size_t size)
+	{
+		if (m_size + size > m_capacity)
+		{
+			grow(m_size + size);
+		}
+		return m_code + m_size;
+	}
+
+	void grow(size_t needed)
+	{
+#ifdef JIT_NATIVE
+		if (needed > max_code)
+		{
+			throw std::runtime_error("The program's too big to compile to native code.");
+		}
+		if (m_code == nullptr)
+		{
+			// Only reserved, so it costs nothing until pages are added.
+			void* reserved = ::mmap(nullptr, max_code, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			if (reserved == MAP_FAILED)
+			{
+				throw std::bad_alloc();
+			}
+			m_code = static_cast<uint8_t*>(reserved);
+		}
+		static const size_t page = ::sysconf(_SC_PAGESIZE);
+		size_t capacity = std::min((std::max(needed, m_capacity * 2) + page - 1) / page * page, max_code);
+		if (::mprotect(m_code + m_capacity, capacity - m_capacity, PROT_READ | PROT_WRITE) != 0)
+		{
+			throw std::bad_alloc();
+		}
+		m_capacity = capacity;
+#else
+		throw std::logic_error("Native code can't be generated here.");
+#endif
+	}
+
+	uint8_t* m_code;
+	size_t m_size;
+	size_t m_capacity;
+};
+
+//! COMPILER
+
+/// Compiles runs of assignments into native functions, mirroring what `eval` does with each node.
+class compiler
+{
+public:
+	compiler(const ast::tree& code, interpreter::engine& engine, program& out)
+		: m_code(code), m_engine(engine), m_out(out), m_open(false), m_statement(0), m_empty(no_constant)
+	{
+	}
+
+	void compile()
+	{
+		m_engine.resolve(m_code, m_out.slots);
+		size_t variables = m_engine.state().size();
+		bool native		 = supported() && variables < max_index && m_code.size() < max_index;
+		m_defined.resize(variables);
+		if (native)
+		{
+			// Most statements take a couple of moves.
+			m_asm.reserve(m_code.children(m_code.root()).size() * 16);
+
+			// Every function shares the epilogue at the start, and jumps there with what to return in eax.
+			m_asm.bytes({
+				0x48, 0x83, 0xC4, 0x08, // add rsp, 8
+				0x41, 0x5F,				// pop r15
+				0x41, 0x5E,				// pop r14
+				0x41, 0x5D,				// pop r13
+				0x41, 0x5C,				// pop r12
+				0x5D,					// pop rbp
+				0x5B,					// pop rbx
+				0xC3,					// ret
+			});
+		}
+
+		for (node_id node : m_code.children(m_code.root()))
+		{
+			// Only assignments do anything.
+			if (m_code.type(node) != kind::assignment)
+			{
+				continue;
+			}
+			if (!native || m_code.type(m_code.children(node).at(0)) != kind::identifier)
+			{
+				// The interpreter runs it instead, and throws if it's invalid.
+				close();
+				m_out.blocks.push_back({ no_entry, m_out.statements.size(), m_out.statements.size() + 1 });
+				m_out.statements.push_back(node);
+				continue;
+			}
+			if (!m_open)
+			{
+				open();
+			}
+			statement(node);
+			m_out.statements.push_back(node);
+			++m_out.compiled;
+		}
+		close();
+		map();
+	}
+
+private:
+	/// Start a block's function.
+	void open()
+	{
+		m_out.blocks.push_back({ m_asm.size(), m_out.statements.size(), m_out.statements.size() });
+		m_open = true;
+		// Nothing's known about the state when a block starts.
+		for (slot var : m_stored)
+		{
+			m_defined[var] = false;
+		}
+		m_stored.clear();
+		m_asm.bytes({
+			0x53,					// push rbx
+			0x55,					// push rbp
+			0x41, 0x54,				// push r12
+			0x41, 0x55,				// push r13
+			0x41, 0x56,				// push r14
+			0x41, 0x57,				// push r15
+			0x48, 0x83, 0xEC, 0x08, // sub rsp, 8, to align the stack for calls
+		});
+		m_asm.copy(values_reg, rdi);
+		m_asm.copy(assigned_reg, rsi);
+		m_asm.copy(scratch_reg, rdx);
+		m_asm.copy(constants_reg, rcx);
+		m_asm.copy(operators_reg, r8);
+		m_asm.move(apply_reg, reinterpret_cast<uint64_t>(&apply));
+	}
+
+	/// End the open block's function, if there is one, returning that it ran every statement.
+	void close()
+	{
+		if (!m_open)
+		{
+			return;
+		}
+		m_open			  = false;
+		block& open		  = m_out.blocks.back();
+		open.end		  = m_out.statements.size();
+		open.stored_begin = m_out.stored.size();
+		m_out.stored.insert(m_out.stored.end(), m_stored.begin(), m_stored.end());
+		open.stored_end = m_out.stored.size();
+		m_asm.move32(rax, open.end - open.begin);
+		m_asm.jump(0);
+
+		// The ways out of the block are kept after it, out of the way of the code that runs.
+		// Every way out of a statement shares one.
+		for (size_t i = 0; i < m_exits.size(); ++i)
+		{
+			m_asm.land_far(m_exits[i].first);
+			if (i + 1 == m_exits.size() || m_exits[i + 1].second != m_exits[i].second)
+			{
+				m_asm.move32(rax, m_exits[i].second);
+				m_asm.jump(0);
+			}
+		}
+		m_exits.clear();
+	}
+
+	void statement(node_id node)
+	{
+		m_statement = m_out.statements.size() - m_out.blocks.back().begin;
+
+		node_id lhs = m_code.children(node).at(0);
+		node_id rhs = m_code.children(node).at(2);
+
+		switch (m_code.type(rhs))
+		{
+		case kind::identifier:
+			// Leave it to the interpreter if the variable's undefined, which throws.
+			if (!m_defined[m_out.slots[rhs]])
+			{
+				m_asm.test_byte(assigned_reg, m_out.slots[rhs]);
+				leave_if(equal);
+			}
+			m_asm.load(values_reg, value(m_out.slots[rhs]));
+			break;
+		case kind::expression:
+			expression(rhs, 0);
+			m_asm.load(scratch_reg, value(0));
+			break;
+		default:
+			m_asm.load(constants_reg, value(literal(rhs)));
+		}
+		m_asm.store(values_reg, value(m_out.slots[lhs]));
+		// A variable only needs marking assigned the first time the block stores it.
+		slot target = m_out.slots[lhs];
+		if (!m_defined[target])
+		{
+			m_asm.set_byte(assigned_reg, target, 1);
+			m_defined[target] = true;
+			m_stored.push_back(target);
+		}
+	}
+
+	/// Work out the expression into the temporary.
+	void expression(node_id node, size_t temporary)
+	{
+		m_out.temporaries = std::max(m_out.temporaries, temporary + 1);
+		for (node_id child : m_code.children(node))
+		{
+			if (m_code.type(child) == kind::arithmetic)
+			{
+				arithmetic(child, temporary);
+				return;
+			}
+		}
+		m_asm.load(constants_reg, value(empty()));
+		m_asm.store(scratch_reg, value(temporary));
+	}
+
+	void arithmetic(node_id node, size_t temporary)
+	{
+		operand(m_code.children(node).at(0), temporary);
+		operand(m_code.children(node).at(2), temporary + 1);
+
+		m_asm.address(rdi, scratch_reg, value(temporary));
+		m_asm.move32(rsi, oper(m_code.text(m_code.children(node).at(1))));
+		m_asm.copy(rdx, operators_reg);
+		m_asm.call(apply_reg);
+		m_asm.bytes({ 0x84, 0xC0 }); // test al, al
+		leave_if(equal);
+	}
+
+	void operand(node_id node, size_t temporary)
+	{
+		m_out.temporaries = std::max(m_out.temporaries, temporary + 1);
+		switch (m_code.type(node))
+		{
+		case kind::identifier:
+		{
+			if (m_defined[m_out.slots[node]])
+			{
+				m_asm.load(values_reg, value(m_out.slots[node]));
+				m_asm.store(scratch_reg, value(temporary));
+				break;
+			}
+			// Undefined operands are empty.
+			m_asm.load(constants_reg, value(empty()));
+			m_asm.test_byte(assigned_reg, m_out.slots[node]);
+			size_t undefined = m_asm.jump_if(equal);
+			m_asm.load(values_reg, value(m_out.slots[node]));
+			m_asm.land(undefined);
+			m_asm.store(scratch_reg, value(temporary));
+			break;
+		}
+		case kind::expression:
+			expression(node, temporary);
+			break;
+		case kind::arithmetic:
+			arithmetic(node, temporary);
+			break;
+		default:
+			m_asm.load(constants_reg, value(literal(node)));
+			m_asm.store(scratch_reg, value(temporary));
+		}
+	}
+
+	/// Return from the function if the condition holds, saying that the current statement wasn't run.
+	void leave_if(condition when)
+	{
+		m_exits.push_back({ m_asm.jump_far_if(when), m_statement });
+	}
+
+	/// The displacement of a value in an array.
+	static int32_t value(size_t index)
+	{
+		return static_cast<int32_t>(index * sizeof(variable));
+	}
+
+	uint32_t literal(node_id node)
+	{
+		// Interned literals are told apart by their symbols, the rest by their text.
+		symbol::id sym = m_code.symbol(node);
+		uint32_t next  = m_out.constants.size();
+		uint32_t index = sym != symbol::none
+							 ? m_interned.try_emplace(sym, next).first->second
+							 : m_literals[static_cast<size_t>(m_code.type(node))].try_emplace(m_code.stored_text(node), next).first->second;
+		if (index == next)
+		{
+			m_out.constants.push_back(variable(m_code, node));
+		}
+		return index;
+	}
+
+	uint32_t empty()
+	{
+		if (m_empty == no_constant)
+		{
+			m_empty = m_out.constants.size();
+			m_out.constants.push_back(variable());
+		}
+		return m_empty;
+	}
+
+	uint32_t oper(std::string_view oper)
+	{
+		auto [found, added] = m_operators.try_emplace(oper, m_out.operators.size());
+		if (added)
+		{
+			m_out.operators.emplace_back(oper);
+		}
+		return found->second;
+	}
+
+	/// Make the code executable, or leave every block to the interpreter if it can't be.
+	void map()
+	{
+		if (m_out.compiled != 0)
+		{
+			m_out.native	  = m_asm.finish();
+			m_out.native_size = m_asm.size();
+		}
+		if (m_out.native == nullptr)
+		{
+			for (block& b : m_out.blocks)
+			{
+				b.entry = no_entry;
+			}
+			m_out.compiled	  = 0;
+			m_out.native_size = 0;
+		}
+	}
+
+	static constexpr uint32_t no_constant = std::numeric_limits<uint32_t>::max();
+
+	const ast::tree& m_code;
+	interpreter::engine& m_engine;
+	program& m_out;
+	assembler m_asm;
+	/// Whether the last block's function is still being compiled.
+	bool m_open;
+	/// Whether each variable is known to be assigned, because the open block has stored it.
+	std::vector<uint8_t> m_defined;
+	/// The variables the open block has stored.
+	std::vector<slot> m_stored;
+	/// The open block's jumps out, and the statement each leaves at.
+	std::vector<std::pair<size_t, uint32_t>> m_exits;
+	/// The statement being compiled, counted from the start of its block.
+	size_t m_statement;
+	/// Literal constants by kind and text, which view into the tree.
+	std::unordered_map<std::string_view, uint32_t> m_literals[static_cast<size_t>(kind::expression) + 1];
+	/// Interned literal constants by symbol.
+	std::unordered_map<symbol::id, uint32_t> m_interned;
+	/// The empty constant, if there is one yet.
+	uint32_t m_empty;
+	std::unordered_map<std::string_view, uint32_t> m_operators;
+};
+
+program compile(const ast::tree& code, interpreter::engine& engine)
+{
+	program compiled;
+	compiler(code, engine, compiled).compile();
+	const interpreter::env& state = engine.state();
+	for (slot var = 0; var < state.size(); ++var)
+	{
+		compiled.names.push_back(state.name(var));
+	}
+	return compiled;
+}
+
+//! RUNNING
+
+void run(const program& compiled, const ast::tree& code, interpreter::engine& engine)
+{
+	interpreter::env& state = engine.state();
+	// The slots are built into the code, so the state has to lay the variables out the same way.
+	for (slot var = 0; var < compiled.names.size(); ++var)
+	{
+		if (state.resolve(compiled.names[var]) != var)
+		{
+			throw std::runtime_error("The program was compiled against a different state.");
+		}
+	}
+
+	// Native code indexes the variables directly, so it runs on a flat copy of them. Whatever the native
+	// code or the interpreter changes is copied over to the other before the other goes on.
+	size_t variables = compiled.native != nullptr ? compiled.names.size() : 0;
+	std::vector<variable> values(variables);
+	std::vector<uint8_t> assigned(variables);
+	for (slot var = 0; var < variables; ++var)
+	{
+		if (state.assigned(var))
+		{
+			values[var]	  = state.value(var);
+			assigned[var] = true;
+		}
+	}
+
+	std::vector<variable> scratch(compiled.temporaries);
+	for (const block& b : compiled.blocks)
+	{
+		size_t next = b.begin;
+		if (b.entry != no_entry)
+		{
+			auto function = reinterpret_cast<native_function>(compiled.native.get() + b.entry);
+			next += function(values.data(), assigned.data(), scratch.data(), compiled.constants.data(),
+							 compiled.operators.data());
+			for (size_t i = b.stored_begin; i < b.stored_end; ++i)
+			{
+				slot var = compiled.stored[i];
+				if (assigned[var])
+				{
+					state.assign(var, values[var]);
+				}
+			}
+			if (failure)
+			{
+				std::rethrow_exception(std::exchange(failure, nullptr));
+			}
+		}
+		// The interpreter takes over from whatever stopped the native code, which throws there too.
+		for (; next < b.end; ++next)
+		{
+			node_id statement = compiled.statements[next];
+			engine.execute(code, compiled.slots, statement);
+			if (variables != 0)
+			{
+				slot var	  = compiled.slots[code.children(statement)[0]];
+				values[var]	  = state.value(var);
+				assigned[var] = true;
+			}
+		}
+	}
+}
+
+}
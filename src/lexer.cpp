@@ -1,112 +1,552 @@
-#include <regex>
-#include <stdexcept>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <thread>
 #include <tuple>
+#include <utility>
 #include "lexer.hpp"
+#include "scan.hpp"
 
 namespace lexer
 {
 
 /**
- * @brief Associates a token type with a regex matcher.
- * 
+ * @brief The character classes the token automaton transitions on.
+ *
  */
-struct matcher
+enum char_class : uint8_t
 {
-	matcher(std::string type, std::string pattern)
-		: type(type), regex(pattern)
+	cc_other,
+	cc_letter,		// A-Za-z
+	cc_ident,		// _ and $, which may only begin an identifier.
+	cc_digit,		// 0-9
+	cc_quote,		// "
+	cc_newline,		// \n
+	cc_break,		// \r and \0, which a string literal can't span.
+	cc_operator,	// + - * / =
+	cc_semicolon,	// ;
+	cc_parens,		// ( )
+	cc_colon,		// :
+	cc_comma,		// ,
+	cc_count
+};
+
+/**
+ * @brief The token automaton's states. A state is accepting if it has a token type.
+ *
+ */
+enum state : uint8_t
+{
+	st_dead,
+	st_start,
+	st_identifier,
+	st_number,
+	st_string_open,
+	st_string,
+	st_operator,
+	st_separator,
+	st_parens,
+	st_colon,
+	st_comma,
+	st_count
+};
+
+/**
+ * @brief A deterministic automaton recognizing every valid token at once.
+ *
+ */
+struct automaton
+{
+	/// The class of every input byte.
+	std::array<char_class, 256> classes;
+	/// The state transition table, indexed by [state][class].
+	std::array<std::array<state, cc_count>, st_count> next;
+	/// The token kind accepted by each state, or token_kind::error if it's not accepting.
+	std::array<token_kind, st_count> accepts;
+};
+
+/**
+ * @brief Compiles the token definitions into a single automaton.
+ *
+ * The definitions, as the regexes they replace, in order of priority:
+ * 	identifier => [A-Za-z_$][A-Za-z0-9]*
+ * 	number => [0-9]+
+ * 	string => ".*"
+ * 	operator => \+|-|\*|/|=
+ * 	separator => ;|\n
+ * 	parens => \(|\)
+ * 	colon => :
+ * 	comma => ,
+ *
+ * No two definitions share a first character, so the longest match from `st_start`
+ * is the same token the first matching regex would have produced.
+ *
+ * Blanks (everything `\s` matches except newlines) between tokens are skipped by scan::skip_blank,
+ * and comments, from a # to the end of the line, are skipped by chunked_lexer::run.
+ */
+constexpr automaton compile()
+{
+	automaton a{};
+
+	for (int c = 0; c < 256; ++c)
+	{
+		char_class cls = cc_other;
+		if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')) cls = cc_letter;
+		else if (c == '_' || c == '$') cls = cc_ident;
+		else if (c >= '0' && c <= '9') cls = cc_digit;
+		else if (c == '"') cls = cc_quote;
+		else if (c == '\n') cls = cc_newline;
+		else if (c == '\r' || c == '\0') cls = cc_break;
+		else if (c == '+' || c == '-' || c == '*' || c == '/' || c == '=') cls = cc_operator;
+		else if (c == ';') cls = cc_semicolon;
+		else if (c == '(' || c == ')') cls = cc_parens;
+		else if (c == ':') cls = cc_colon;
+		else if (c == ',') cls = cc_comma;
+		a.classes[c] = cls;
+	}
+
+	for (int s = 0; s < st_count; ++s)
+	{
+		for (int c = 0; c < cc_count; ++c)
+		{
+			a.next[s][c] = st_dead;
+		}
+		a.accepts[s] = token_kind::error;
+	}
+
+	// identifier
+	a.next[st_start][cc_letter]		 = st_identifier;
+	a.next[st_start][cc_ident]		 = st_identifier;
+	a.next[st_identifier][cc_letter] = st_identifier;
+	a.next[st_identifier][cc_digit]	 = st_identifier;
+	a.accepts[st_identifier]		 = token_kind::identifier;
+
+	// number
+	a.next[st_start][cc_digit]	 = st_number;
+	a.next[st_number][cc_digit]	 = st_number;
+	a.accepts[st_number]		 = token_kind::number;
+
+	// string, greedy up to the last quote on the line.
+	a.next[st_start][cc_quote] = st_string_open;
+	for (int c = 0; c < cc_count; ++c)
+	{
+		if (c == cc_newline || c == cc_break) continue;
+		a.next[st_string_open][c] = c == cc_quote ? st_string : st_string_open;
+		a.next[st_string][c]	  = c == cc_quote ? st_string : st_string_open;
+	}
+	a.accepts[st_string] = token_kind::string;
+
+	// single-character tokens
+	a.next[st_start][cc_operator]  = st_operator;
+	a.next[st_start][cc_semicolon] = st_separator;
+	a.next[st_start][cc_newline]   = st_separator;
+	a.next[st_start][cc_parens]	   = st_parens;
+	a.next[st_start][cc_colon]	   = st_colon;
+	a.next[st_start][cc_comma]	   = st_comma;
+	a.accepts[st_operator]		   = token_kind::oper;
+	a.accepts[st_separator]		   = token_kind::separator;
+	a.accepts[st_parens]		   = token_kind::parens;
+	a.accepts[st_colon]			   = token_kind::colon;
+	a.accepts[st_comma]			   = token_kind::comma;
+
+	return a;
+}
+
+/// All valid tokens in the language.
+static constexpr automaton valid_tokens = compile();
+
+/// Get the class of a character.
+inline char_class class_of(char ch)
+{
+	return valid_tokens.classes[static_cast<unsigned char>(ch)];
+}
+
+/// Get the position of the first non-blank character at or after pos.
+inline size_t skip_blank(std::string_view code, size_t pos)
+{
+	return scan::skip_blank(code, pos);
+}
+
+/**
+ * @brief Find where a comment begins after the opening quote of a string, if it does before end.
+ *
+ * @remarks Quotes toggle whether we're in a string unless escaped with a backslash,
+ * and a # outside of one begins a comment.
+ */
+size_t find_comment(std::string_view code, size_t pos, size_t end)
+{
+	if (code.substr(pos, end - pos).find('#') == std::string_view::npos)
+	{
+		return std::string_view::npos;
+	}
+
+	bool in_string = true;
+	for (size_t i = pos; i < end; ++i)
+	{
+		if (code[i] == '"' && code[i - 1] != '\\')
+		{
+			in_string = !in_string;
+		}
+		else if (!in_string && code[i] == '#')
+		{
+			return i;
+		}
+	}
+	return std::string_view::npos;
+}
+
+/**
+ * @brief Matches a string literal, which is greedy up to the last quote on the line
+ * before any comment, without stepping through the automaton.
+ *
+ * @param code The code
+ * @param pos The position after the opening quote.
+ * @param raw See longest_match.
+ * @return std::tuple<state, size_t, bool, bool> See longest_match.
+ */
+std::tuple<state, size_t, bool, bool> match_string(std::string_view code, size_t pos, bool raw)
+{
+	size_t line_end = scan::find_line_end(code, pos, true);
+	size_t first_cr = std::string_view::npos;
+	if (!raw && line_end < code.size() && code[line_end] == '\r')
+	{
+		// Carriage returns are skipped over outside of the first token.
+		first_cr = line_end;
+		line_end = scan::find_line_end(code, line_end, false);
+	}
+	bool exhausted = line_end == code.size();
+
+	if (size_t comment = find_comment(code, pos, line_end); comment != std::string_view::npos)
+	{
+		line_end  = comment;
+		exhausted = false;
+	}
+
+	size_t quote = code.substr(0, line_end).rfind('"');
+	if (quote == std::string_view::npos || quote < pos)
 	{
+		return { st_dead, pos, false, exhausted };
 	}
+	return { st_string, quote + 1, first_cr < quote, exhausted };
+}
 
-	/**
-	 * @brief Tries to match the next few characters in the code with this matcher's pattern.
-	 * 
-	 * @param code The code
-	 * @return std::tuple<bool>
-	 * 	1: bool -> If it successfully matched.
-	 * 	2: int -> Length of match
-	 * 	3: string -> matched token value
-	 */
-	std::tuple<bool, int, std::string> try_match(const std::string& code) const
+/**
+ * @brief Strips carriage returns, and any blanks following them, out of a token.
+ *
+ * @remarks The old regex lexer stripped them out of the code between tokens,
+ * since `.` doesn't match a carriage return.
+ */
+std::string strip_carriage_returns(std::string_view in)
+{
+	std::string ret;
+	for (size_t i = 0; i < in.size();)
 	{
-		std::cmatch m;
-		if (std::regex_search(code.c_str(), m, regex) && m.position() == 0)
+		if (in[i] == '\r')
 		{
-			return {
-				true, m.length(), m.str()
-			};
+			i = skip_blank(in, i);
 		}
 		else
 		{
-			return {
-				false, -1, ""
-			};
+			ret += in[i++];
 		}
 	}
+	return ret;
+}
 
-	std::string type;
-	std::regex regex;
-};
+/**
+ * @brief Runs the automaton over the code, starting at pos.
+ *
+ * @param code The code
+ * @param pos The position the token begins at.
+ * @param raw Whether the code is as read from the file. Only the first token is matched against raw code,
+ * every token after it has carriage returns, and any blanks following them, skipped over.
+ * @return std::tuple<state, size_t, bool, bool>
+ * 	1: state -> The last accepting state reached, or st_dead if there was none.
+ * 	2: size_t -> The position after the longest match.
+ * 	3: bool -> If the match contains a skipped carriage return.
+ * 	4: bool -> If the automaton ran into the end of the code, so more code could extend the match.
+ */
+std::tuple<state, size_t, bool, bool> longest_match(std::string_view code, size_t pos, bool raw)
+{
+	state current	= st_start;
+	state accepted	= st_dead;
+	size_t end		= pos;
+	bool skipped	= false;
+	bool stripped	= false;
 
-/// All valid tokens in the language.
-std::vector<matcher> valid_tokens = {
-	matcher("identifier", "[A-Za-z_$][A-Za-z0-9]*"),
-	matcher("number", "[0-9]+"),
-	matcher("string", "\".*\""),
-	matcher("operator", "\\+|-|\\*|/|="),
-	matcher("separator", ";|\n"),
-	matcher("parens", "\\(|\\)"),
-	matcher("colon", ":"),
-	matcher("comma", ",")
+	while (pos < code.size())
+	{
+		if (!raw && code[pos] == '\r')
+		{
+			pos		= skip_blank(code, pos);
+			skipped = true;
+			continue;
+		}
+
+		current = valid_tokens.next[current][class_of(code[pos])];
+		if (current == st_dead)
+		{
+			break;
+		}
+
+		++pos;
+
+		// Fast-forward through the runs of characters a state loops on.
+		if (current == st_identifier)
+		{
+			pos = scan::skip_alnum(code, pos);
+		}
+		else if (current == st_number)
+		{
+			pos = scan::skip_digits(code, pos);
+		}
+		else if (current == st_string_open)
+		{
+			return match_string(code, pos, raw);
+		}
+
+		if (valid_tokens.accepts[current] != token_kind::error)
+		{
+			accepted = current;
+			end		 = pos;
+			stripped = skipped;
+		}
+	}
+
+	return { accepted, end, stripped, pos == code.size() };
+}
+
+/**
+ * @brief Get the first few characters of the code, for error messages.
+ *
+ * @remarks Matches what the old lexer printed, which was the remaining code with
+ * blanks stripped from the start of each line and after every carriage return.
+ */
+std::string snippet(std::string_view code)
+{
+	const size_t length = 10;
+
+	std::string ret;
+	for (size_t pos = 0; pos < code.size() && ret.size() < length;)
+	{
+		if (code[pos] == '\r')
+		{
+			pos = skip_blank(code, pos);
+			continue;
+		}
+
+		ret += code[pos++];
+		if (ret.back() == '\n')
+		{
+			pos = skip_blank(code, pos);
+		}
+	}
+	return ret;
+}
+
+/// The names of each token kind, for printing.
+static const char* kind_names[] = {
+	"identifier",
+	"number",
+	"string",
+	"operator",
+	"separator",
+	"parens",
+	"colon",
+	"comma",
+	"ERROR"
 };
 
-/// Strips leading and trailing whitespace off input string.
-std::string strip(const std::string& in)
+std::string token::type() const
 {
-	return std::regex_replace(in, std::regex("[^\\S\n]*(.*)[^\\S\n]*"), "$1");
+	return kind_names[static_cast<size_t>(kind)];
+}
+
+std::string token::value() const
+{
+	if (kind == token_kind::error)
+	{
+		return "Syntax Error at: " + (stripped ? snippet(text) : std::string(text.substr(0, 10))) + "...";
+	}
+	return stripped ? strip_carriage_returns(text) : std::string(text);
 }
 
 /**
- * @brief Consumes the next valid token from the code string.
- * 
- * @param code RW access to the input code.
- * @return token The next valid token in the code.
+ * @brief Find the first position at or after pos that lexing can safely start over from:
+ * just after a separator that can't be inside a string literal or a comment.
+ *
+ * @remarks A string literal runs up to the last quote on its line, so a semicolon with no quotes
+ * after it, and no # before it, on the same line can't be inside either. Newlines are always separators.
+ * @param code The code
+ * @param pos Where to start looking.
+ * @param partial Whether more code may follow, in which case the last line isn't over yet.
+ * @return size_t The position, or npos if there is none.
  */
-token next_token(std::string& code)
+size_t find_split(std::string_view code, size_t pos, bool partial)
 {
-	for (auto& matcher : valid_tokens)
+	size_t newline	  = pos == 0 ? std::string_view::npos : code.rfind('\n', pos - 1);
+	size_t line_start = newline == std::string_view::npos ? 0 : newline + 1;
+	size_t line_end	  = code.find('\n', pos);
+	if (line_end == std::string_view::npos)
 	{
-		auto [success, length, value] = matcher.try_match(code);
-		if (success)
+		if (partial)
 		{
-			code = strip(code.substr(length));
-			return {
-				matcher.type, value
-			};
+			return std::string_view::npos;
 		}
+		line_end = code.size();
 	}
-	// This code here is only reached if no token matched, indicating a syntax error.
-	token err = { "ERROR", "Syntax Error at: " + code.substr(0, 10) + "..." };
-	code	  = "";   // this is to terminate the lexer early.
-	return err;
+	std::string_view line = code.substr(line_start, line_end - line_start);
+
+	size_t from	 = pos - line_start;
+	size_t quote = line.rfind('"');
+	if (quote != std::string_view::npos)
+	{
+		from = std::max(from, quote + 1);
+	}
+	size_t separator = line.substr(0, line.find('#')).find(';', from);
+	if (separator != std::string_view::npos)
+	{
+		return line_start + separator + 1;
+	}
+
+	return line_end < code.size() ? line_end + 1 : std::string_view::npos;
+}
+
+chunked_lexer::chunked_lexer(size_t jobs)
+	: m_jobs(jobs), m_pos(0), m_raw(true), m_failed(false)
+{
 }
 
-std::vector<token> lex(const std::string& code)
+void chunked_lexer::feed(std::string_view code)
 {
-	// Copy code for writing.
-	std::string code_rw = code;
+	run(code, true);
+}
+
+std::vector<token> chunked_lexer::finish(std::string_view code)
+{
+	run(code, false);
+
+	// The error token views all the remaining code, so it's only made once all of it is here.
+	if (m_failed)
+	{
+		m_tokens.push_back({ token_kind::error, !m_raw, code.substr(m_pos) });
+	}
+
+	return std::move(m_tokens);
+}
 
-	// vector of tokens
-	std::vector<token> tokens;
+void chunked_lexer::run(std::string_view code, bool partial)
+{
+	if (m_jobs > 1 && !m_failed && code.size() - m_pos >= parallel_threshold)
+	{
+		run_parallel(code, partial);
+	}
 
 	// While there is still code left
-	while (code_rw.size() != 0)
+	while (!m_failed)
+	{
+		// Skip the whitespace and comments up to the next token.
+		if (!m_raw)
+		{
+			m_pos = skip_blank(code, m_pos);
+		}
+		if (m_pos < code.size() && code[m_pos] == '#')
+		{
+			size_t line_end = code.find('\n', m_pos);
+			if (line_end == std::string_view::npos)
+			{
+				// The comment may go on into the next chunk.
+				if (partial)
+				{
+					break;
+				}
+				line_end = code.size();
+			}
+			m_pos = line_end;
+			continue;
+		}
+		if (m_pos >= code.size())
+		{
+			break;
+		}
+
+		auto [accepted, end, stripped, exhausted] = longest_match(code, m_pos, m_raw);
+		if (partial && exhausted)
+		{
+			break;
+		}
+
+		// No token matched, indicating a syntax error.
+		if (accepted == st_dead)
+		{
+			m_failed = true;
+			break;
+		}
+
+		m_tokens.push_back({ valid_tokens.accepts[accepted], stripped, code.substr(m_pos, end - m_pos) });
+		m_pos = end;
+		m_raw = false;
+	}
+}
+
+void chunked_lexer::run_parallel(std::string_view code, bool partial)
+{
+	// Every piece but the last ends just after a separator.
+	std::vector<size_t> splits = { m_pos };
+	for (size_t i = 1; i < m_jobs; ++i)
 	{
-		// gobble up the next token, and append it to the vector.
-		tokens.push_back(next_token(code_rw));
+		size_t target = m_pos + (code.size() - m_pos) * i / m_jobs;
+		size_t split  = find_split(code, std::max(target, splits.back()), partial);
+		if (split == std::string_view::npos || split >= code.size())
+		{
+			break;
+		}
+		splits.push_back(split);
 	}
+	if (splits.size() == 1)
+	{
+		return;
+	}
+
+	// Each piece is lexed by its own lexer, as if everything before it had already been lexed.
+	std::vector<chunked_lexer> pieces(splits.size());
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < pieces.size(); ++i)
+	{
+		chunked_lexer& piece = pieces[i];
+		piece.m_pos			 = splits[i];
+		piece.m_raw			 = i == 0 && m_raw;
 
-	// return the tokens.
-	return tokens;
+		// Pieces that end at a split can't see past it, so the last piece is the only one that can be partial.
+		bool last				= i + 1 == pieces.size();
+		std::string_view window = last ? code : code.substr(0, splits[i + 1]);
+		threads.emplace_back([&piece, window, last, partial] {
+			piece.run(window, last && partial);
+		});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	// Splice the pieces back together, stopping at the first error.
+	for (auto& piece : pieces)
+	{
+		m_tokens.insert(m_tokens.end(), piece.m_tokens.begin(), piece.m_tokens.end());
+		m_pos	 = piece.m_pos;
+		m_raw	 = piece.m_raw;
+		m_failed = piece.m_failed;
+		if (m_failed)
+		{
+			break;
+		}
+	}
 }
 
-}
\ No newline at end of file
+std::vector<token> lex(std::string_view code, size_t jobs)
+{
+	chunked_lexer lexer(jobs);
+	return lexer.finish(code);
+}
+
+}
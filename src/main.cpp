@@ -1,11 +1,23 @@
+#include <algorithm>
+#include <chrono>
 #include <cxxopts.hpp>
+#include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <thread>
+#include "batch.hpp"
+#include "bytecode.hpp"
+#include "cache.hpp"
 #include "interpreter.hpp"
+#include "jit.hpp"
 #include "lexer.hpp"
+#include "optimizer.hpp"
 #include "output.hpp"
 #include "parser.hpp"
 #include "preprocessor.hpp"
+#include "repl.hpp"
+#include "symbol.hpp"
 
 int main(int argc, char** argv)
 {
@@ -16,6 +28,26 @@ int main(int argc, char** argv)
 	options.add_options()
 		("h,help", "Print this help dialog")
 		("i,input", "The input file to interpret", cxxopts::value<std::string>())
+		("cache-dir", "Where to cache lexed files and parse trees. Empty to disable the cache.",
+			cxxopts::value<std::string>()->default_value(cache::default_directory()))
+		("legacy-parser", "Parse with the old rewriting engine, for differential testing.")
+		("hash-cons", "Store identical subtrees of the parse tree only once.")
+		("bytecode", "Compile the parse tree to bytecode and run that, instead of walking the tree.")
+		("jit", "Compile runs of assignments to native code and run that, interpreting whatever can't be compiled.")
+		("O,optimize", "The optimization level: 0 runs the tree as parsed, 1 folds constants, reuses common "
+			"subexpressions and removes dead stores first.", cxxopts::value<int>()->default_value("0"))
+		("r,repl", "Start an interactive session, after running the input file if there is one.")
+		("batch", "Run every script in a directory, or listed a path per line in a manifest file, on --jobs threads.",
+			cxxopts::value<std::string>())
+		("batch-prefix", "A script to run once before the batch, whose state every script in it starts from.",
+			cxxopts::value<std::string>())
+		("batch-output", "Where batch mode writes each script's variable trace, and report.tsv with how every script went.",
+			cxxopts::value<std::string>()->default_value("slang-batch"))
+		("j,jobs", "The most threads to lex and parse with, or to run scripts on in batch mode.",
+			cxxopts::value<size_t>()->default_value(std::to_string(std::thread::hardware_concurrency())))
+		("output-format", "How to print messages: text, or json for a JSON object per message.",
+			cxxopts::value<std::string>()->default_value("text"))
+		("async-output", "Write messages out on a background thread.")
 		("v,verbose", "Increases the verbosity.");
 	// clang-format on
 
@@ -31,8 +63,11 @@ int main(int argc, char** argv)
 		return 0;
 	}
 
+	bool interactive = result["repl"].count() != 0;
+	bool batched	 = result["batch"].count() != 0;
+
 	// Check for the input file
-	if (result["input"].count() == 0)
+	if (result["input"].count() == 0 && !interactive && !batched)
 	{
 		std::cerr << "No input file specified!";
 		return -1;
@@ -41,70 +76,275 @@ int main(int argc, char** argv)
 	// Get verbosity.
 	int verbosity = result["verbose"].count();
 
-	// Initialize stdout.
-	output out(verbosity);
-	out(1, "Reading input file...\n");
-
-	// Get the input file
-	std::string input = result["input"].as<std::string>();
-	// Read the input file
-	std::ifstream file(input);
-	if (!file)
+	// With no file to run, go straight to the interactive session.
+	interpreter::engine engine;
+	if (result["input"].count() == 0 && !batched)
 	{
-		std::cerr << "Could not open source file for reading!";
-		return -1;
+		repl::session(engine, result["hash-cons"].count() != 0).run(std::cin, std::cout);
+		return 0;
 	}
-	std::string code = std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
-	file.close();
-	out(1, "File read successfully.\n");
-
-	out(3, "Preprocessing...\n");
-	code = preprocessor::preprocess(code);
-	out(3, "Preprocessed!\n");
-
-	out(3, "Lexing code for tokens.\n");
-	// Lex the code.
-	auto tokens = lexer::lex(code);
-	if (tokens.size() == 0)
+
+	// Initialize stdout.
+	std::string format = result["output-format"].as<std::string>();
+	if (format != "text" && format != "json")
 	{
-		std::cerr << "Input file is empty.\n";
+		std::cerr << "Unknown output format " << format << "!";
 		return -1;
 	}
+	output out(verbosity, format == "json" ? output::format::json : output::format::text, result["async-output"].count() != 0);
 
-	// Check for token errors.
-	if (tokens.back().type == "ERROR")
+	// Run every script in the batch, in this process, instead of a single one.
+	if (batched)
 	{
-		std::cerr << "Lexer failed.\nError: " << tokens.back().value << std::endl;
-		return -1;
+		batch::options opts;
+		opts.output_dir		 = result["batch-output"].as<std::string>();
+		opts.cache_dir		 = result["cache-dir"].as<std::string>();
+		opts.parse.method	 = result["legacy-parser"].count() != 0 ? parser::engine::rewrite : parser::engine::pratt;
+		opts.parse.hash_cons = result["hash-cons"].count() != 0;
+		opts.optimize		 = result["optimize"].as<int>() > 0;
+		opts.jobs			 = std::max<size_t>(result["jobs"].as<size_t>(), 1);
+		if (result["batch-prefix"].count() != 0)
+		{
+			opts.prefix = result["batch-prefix"].as<std::string>();
+		}
+		if (result["jit"].count() != 0)
+		{
+			opts.execute = batch::executor::jit;
+		}
+		else if (result["bytecode"].count() != 0)
+		{
+			opts.execute = batch::executor::bytecode;
+		}
+
+		std::vector<batch::script> scripts;
+		try
+		{
+			scripts = batch::collect(result["batch"].as<std::string>());
+			std::filesystem::create_directories(opts.output_dir);
+		}
+		catch (std::exception& e)
+		{
+			out.error(std::string(e.what()) + "\n");
+			return -1;
+		}
+		out(1, "Running ", scripts.size(), " scripts on ", opts.jobs, " threads.\n");
+
+		auto begin = std::chrono::steady_clock::now();
+		std::vector<batch::result> results;
+		try
+		{
+			results = batch::run(scripts, opts);
+		}
+		catch (std::exception& e)
+		{
+			out.error(std::string(e.what()) + "\n");
+			return -1;
+		}
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+		std::string report = (std::filesystem::path(opts.output_dir) / "report.tsv").string();
+		std::ofstream report_file(report);
+		batch::report(report_file, scripts, results, elapsed);
+
+		size_t failed = 0;
+		for (size_t i = 0; i < scripts.size(); ++i)
+		{
+			if (!results[i].ok)
+			{
+				++failed;
+				out(1, scripts[i].path, ": ", results[i].error, "\n");
+			}
+		}
+		out(0, scripts.size() - failed, " of ", scripts.size(), " scripts ran, in ", elapsed * 1000, " ms. Report written to ",
+			report, ".\n");
+		return failed == 0 ? 0 : 1;
 	}
 
-	// Print all tokens.
-	out(3, "\nTokens retrieved. Tokens:\n--\n");
-	for (auto& tok : tokens)
+	out(1, "Reading input file...\n");
+
+	// Get the input file
+	std::string input = result["input"].as<std::string>();
+	bool legacy = result["legacy-parser"].count() != 0;
+	parser::options parse_options;
+	parse_options.method	= legacy ? parser::engine::rewrite : parser::engine::pratt;
+	parse_options.hash_cons = result["hash-cons"].count() != 0;
+	parse_options.jobs		= std::max<size_t>(result["jobs"].as<size_t>(), 1);
+	bool optimize			= result["optimize"].as<int>() > 0;
+	uint64_t variant		= preprocessor::tree_variant(parse_options, optimize);
+
+	preprocessor::loader loader(result["cache-dir"].as<std::string>(), parse_options.jobs);
+
+	// Skip lexing and parsing entirely if the program's parse tree is cached.
+	std::optional<ast::tree> parsed = loader.load_tree(input, variant);
+	if (parsed.has_value())
 	{
-		out(3, tok.type + ": " + tok.value + "\n");
+		out(1, "File read successfully.\n");
+		out(3, "Parse tree cache hit: ", parsed->size(), " nodes mapped.\n");
 	}
+	else
+	{
+		// Load the input file, and everything it imports.
+		out(3, "Lexing code for tokens.\n");
+		std::vector<lexer::token> tokens;
+		try
+		{
+			tokens = loader.load(input);
+		}
+		catch (std::runtime_error& e)
+		{
+			out.error(e.what());
+			return -1;
+		}
+		out(1, "File read successfully.\n");
+
+		if (loader.caching())
+		{
+			size_t hits = 0;
+			for (auto& [path, mod] : loader.modules())
+			{
+				hits += mod->cached;
+				out(3, "Token cache ", mod->cached ? "hit" : "miss", ": ", path, "\n");
+			}
+			out(3, "Token cache: ", hits, " hits, ", loader.modules().size() - hits, " misses.\n");
+		}
+
+		if (tokens.size() == 0)
+		{
+			out.error("Input file is empty.\n");
+			return -1;
+		}
+
+		// Check for token errors.
+		if (tokens.back().kind == lexer::token_kind::error)
+		{
+			auto [path, line, column] = loader.locate(tokens.back());
+			out.error("Lexer failed at " + path + ":" + std::to_string(line) + ":" + std::to_string(column) + ".\n" +
+					  "Error: " + tokens.back().value() + "\n");
+			return -1;
+		}
+
+		// Print all tokens.
+		out(3, "\nTokens retrieved. Tokens:\n--\n");
+		if (out.enabled(3))
+		{
+			for (auto& tok : tokens)
+			{
+				out(3, tok.type(), ": ", tok.value(), "\n");
+			}
+		}
 
-	// parse tokens
-	out(3, "\nParsing tokens...");
-	auto parsed = parser::parse(tokens);
+		// parse tokens
+		out(3, "\nParsing tokens...");
+		parser::memo_stats memo;
+		try
+		{
+			parsed = parser::parse(tokens, parse_options, &memo);
+		}
+		catch (std::runtime_error& e)
+		{
+			out.error("Parser failed.\nError: " + std::string(e.what()) + "\n");
+			return -1;
+		}
 
+		if (legacy)
+		{
+			out(3, "\nPackrat memo: ", memo.hits, " hits, ", memo.misses, " misses.");
+		}
+		if (parsed->hash_consed() && out.enabled(3))
+		{
+			size_t expanded = parsed->expanded_size();
+			std::ostringstream ratio;
+			ratio << std::fixed << std::setprecision(2) << (double)expanded / std::max<size_t>(parsed->size(), 1);
+			out(3, "\nHash-consing: ", parsed->size(), " nodes stored for ", expanded,
+				", a deduplication ratio of ", ratio.str(), ".");
+		}
+
+		// Optimize before caching, so that a cache hit skips optimizing too.
+		if (optimize)
+		{
+			optimizer::stats report;
+			parsed = optimizer::optimize(*parsed, &report);
+			out(3, "\nOptimizer: folded ", report.folded, ", reused ", report.reused, ", removed ", report.dead_stores,
+				" dead stores and ", report.dropped, " statements that do nothing, eliminating ", report.eliminated,
+				" nodes.");
+		}
+		loader.store_tree(*parsed, variant);
+	}
+	if (out.enabled(3))
+	{
+		// What storing every identifier and string in the tree would have cost.
+		size_t occurrences = 0, bytes = 0;
+		for (ast::node_id id = 0; id < parsed->size(); ++id)
+		{
+			if (ast::interned(parsed->type(id)))
+			{
+				++occurrences;
+				bytes += parsed->text(id).size();
+			}
+		}
+		symbol::statistics interned = symbol::stats();
+		out(3, "\nInterning: ", interned.symbols, " symbols stored in ", interned.stored, " bytes, for ", occurrences,
+			" occurrences in ", bytes, " bytes, saving ", bytes - std::min(bytes, interned.stored), " bytes.");
+	}
 	out(3, "\nParsing complete. Parse tree:\n");
-	out(3, parsed.str());
+	// Printing the tree costs as much as parsing it, so don't build the string unless it's shown.
+	out(3, [&] { return parsed->str(); });
+
+	// Compile the tree, if it isn't interpreted as it is.
+	bool native  = result["jit"].count() != 0;
+	bool compile = !native && result["bytecode"].count() != 0;
+	bytecode::program compiled;
+	jit::program native_code;
+	if (compile)
+	{
+		compiled = bytecode::compile(*parsed);
+		out(3, "\nCompiled to ", compiled.code.size(), " instructions:\n", [&] { return bytecode::str(compiled); });
+	}
+	else if (native)
+	{
+		native_code = jit::compile(*parsed, engine);
+		out(3, "\nCompiled ", native_code.compiled, " of ", native_code.statements.size(), " statements to ",
+			native_code.native_size, " bytes of native code, in ", native_code.blocks.size(), " blocks.\n");
+	}
 
 	// Begin interpreting the code.
 	out(0, "-- slang interpreter begin --\n");
+	// Write out everything so far, so it's not lost if the script brings the process down.
+	out.flush();
 
-	auto end_state = interpreter::interpret(parsed);
+	try
+	{
+		if (compile)
+		{
+			bytecode::run(compiled, engine.state());
+		}
+		else if (native)
+		{
+			jit::run(native_code, *parsed, engine);
+		}
+		else
+		{
+			engine.interpret(*parsed);
+		}
+	}
+	catch (std::runtime_error& e)
+	{
+		out.error("Interpreter failed.\nError: " + std::string(e.what()) + "\n");
+		return -1;
+	}
+	const interpreter::env& end_state = engine.state();
 
 	out(0, "\n-- slang interpreter end --");
 
-	std::ostringstream ss;
-	for (auto& var : end_state.vars)
+	out(3, "\nEnding variable trace:\n", [&] { return end_state.trace(); });
+
+	// Keep going interactively, with the file's variables still defined.
+	if (interactive)
 	{
-		ss << var.first << ": " << var.second.type << " = " << var.second.val << std::endl;
+		out(0, "\n");
+		out.flush();
+		repl::session(engine, parse_options.hash_cons).run(std::cin, std::cout);
 	}
-	out(3, "\nEnding variable trace:\n" + ss.str());
 
 	return 0;
 }
\ No newline at end of file
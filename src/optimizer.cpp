@@ -0,0 +1,477 @@
+#include "optimizer.hpp"
+#include <algorithm>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include "evaluate.hpp"
+#include "value.hpp"
+
+using ast::kind;
+using ast::node_id;
+using interpreter::variable;
+
+namespace optimizer
+{
+
+/// Copy a subtree from one tree to another.
+static node_id copy(const ast::tree& from, node_id node, ast::tree& to)
+{
+	std::vector<node_id> children;
+	for (node_id child : from.children(node))
+	{
+		children.push_back(copy(from, child, to));
+	}
+	return to.branch(from.type(node), children, from.text(node));
+}
+
+/**
+ * @brief Whether a node evaluates to the value, and if so, the node's kind and text.
+ *
+ * @param operand Whether it's for an operand, where arithmetic nodes are evaluated rather than taken as they are.
+ */
+static std::optional<std::pair<kind, std::string>> literal(const variable& value, bool operand)
+{
+	// An expression with no arithmetic in it is empty.
+	if (value.empty())
+	{
+		return std::pair<kind, std::string>(kind::expression, "");
+	}
+	kind type = value.kind();
+	if (type == kind::identifier || type == kind::expression || (operand && type == kind::arithmetic))
+	{
+		return {};
+	}
+
+	// Only fold values that read back exactly the same.
+	std::string text = value.value();
+	if (variable(type, text) != value)
+	{
+		return {};
+	}
+	return std::pair<kind, std::string>(type, std::move(text));
+}
+
+/// Add a node made by `literal`.
+static node_id add_literal(const std::pair<kind, std::string>& literal, ast::tree& to)
+{
+	if (literal.first == kind::expression)
+	{
+		return to.branch(kind::expression, {});
+	}
+	return to.leaf(literal.first, literal.second);
+}
+
+/**
+ * @brief Optimizes a program a statement at a time, mirroring what `eval` does with each node.
+ *
+ * Dead stores can only be found looking back from the end, so the optimized tree is only
+ * built once every statement's been seen. Until then, expressions that can't be folded are
+ * rebuilt in a hash-consed scratch tree, where identical expressions are the same node.
+ */
+class pass
+{
+public:
+	pass(const ast::tree& code, stats& report)
+		: m_code(code), m_scratch(true), m_report(report)
+	{
+	}
+
+	ast::tree run()
+	{
+		for (node_id statement : m_code.children(m_code.root()))
+		{
+			if (m_code.type(statement) != kind::assignment)
+			{
+				// Only assignments do anything.
+				++m_report.dropped;
+				continue;
+			}
+			assignment(statement);
+		}
+		remove_dead_stores();
+
+		ast::tree optimized(m_code.hash_consed());
+
+		// Resolving gives names slots in the order their nodes are in, so add every name up front, in its original order.
+		std::vector<uint8_t> declared;
+		for (node_id node = 0; node < m_code.size(); ++node)
+		{
+			if (m_code.type(node) != kind::identifier)
+			{
+				continue;
+			}
+			symbol::id sym = m_code.symbol(node);
+			if (sym >= declared.size())
+			{
+				declared.resize(sym + 1, false);
+			}
+			if (!declared[sym])
+			{
+				declared[sym] = true;
+				optimized.leaf(kind::identifier, m_code.text(node));
+			}
+		}
+
+		std::vector<node_id> statements;
+		for (auto& s : m_statements)
+		{
+			if (s.kept)
+			{
+				statements.push_back(emit(s, optimized));
+			}
+		}
+		optimized.set_root(optimized.branch(kind::entry, statements, m_code.text(m_code.root())));
+		m_report.eliminated = m_code.size() > optimized.size() ? m_code.size() - optimized.size() : 0;
+		return optimized;
+	}
+
+private:
+	/// An assignment, and what it's been optimized into.
+	struct statement
+	{
+		/// The assignment in the original tree.
+		node_id original;
+		/// The variable assigned, or none if the statement is malformed and left as it is.
+		symbol::id target;
+		/// The value assigned, if it's known.
+		std::optional<variable> value;
+		/// Otherwise, the value's node in the scratch tree.
+		node_id rebuilt;
+		/// Where the variables it reads are in m_reads.
+		size_t reads_begin;
+		size_t reads_end;
+		/// Whether running it may throw, in which case it's never removed, and nothing is moved across it.
+		bool may_throw;
+		bool kept;
+	};
+
+	/// What's known about a variable at the statement being optimized.
+	struct name
+	{
+		/// Its value, if it's known.
+		std::optional<variable> known;
+		/// Whether it's definitely been assigned, so reading it can't throw.
+		bool assigned = false;
+		/// The expressions that read it, which it no longer holds the value of once it's reassigned.
+		std::vector<node_id> dependents;
+		/// The expressions whose values it holds.
+		std::vector<node_id> held;
+	};
+
+	/// An operand, either folded to its value, or rebuilt in the scratch tree.
+	struct folded
+	{
+		std::optional<variable> value;
+		node_id node;
+	};
+
+	void assignment(node_id node)
+	{
+		node_id lhs = m_code.children(node).at(0);
+		node_id rhs = m_code.children(node).at(2);
+
+		statement s = { node, symbol::none, {}, ast::no_node, m_reads.size(), 0, false, true };
+		if (m_code.type(lhs) != kind::identifier)
+		{
+			// This throws when it's run, so leave it for that.
+			s.may_throw = true;
+			s.reads_end = m_reads.size();
+			m_statements.push_back(s);
+			return;
+		}
+		s.target = m_code.symbol(lhs);
+
+		// The same cases as eval::assignment.
+		folded value;
+		if (m_code.type(rhs) == kind::identifier)
+		{
+			symbol::id source = m_code.symbol(rhs);
+			if (state(source).known.has_value())
+			{
+				value.value = state(source).known;
+				++m_report.folded;
+			}
+			else
+			{
+				value.node	= m_scratch.leaf(kind::identifier, m_code.text(rhs));
+				s.may_throw = !state(source).assigned;
+				m_reads.push_back(source);
+			}
+		}
+		else if (m_code.type(rhs) == kind::expression)
+		{
+			value = operand(rhs);
+		}
+		else
+		{
+			value.value = variable(m_code, rhs);
+		}
+
+		// Reuse a variable that already holds the expression's value.
+		node_id expression = no_expression;
+		std::vector<symbol::id> dependencies;
+		if (!value.value.has_value() && m_code.type(rhs) == kind::expression)
+		{
+			expression = value.node;
+			dependencies.assign(m_reads.begin() + s.reads_begin, m_reads.end());
+			if (auto found = m_available.find(expression); found != m_available.end())
+			{
+				m_reads.resize(s.reads_begin);
+				m_reads.push_back(found->second);
+				value.node = m_scratch.leaf(kind::identifier, symbol::text(found->second));
+				++m_report.reused;
+			}
+		}
+
+		// A value that can't be written as a literal is left as it was, which reads what's in it.
+		if (value.value.has_value() && !literal(*value.value, false).has_value())
+		{
+			read_all(rhs);
+		}
+
+		s.value		= value.value;
+		s.rebuilt	= value.node;
+		s.reads_end = m_reads.size();
+		m_statements.push_back(s);
+
+		assign(s.target, value.value, expression, dependencies);
+	}
+
+	/// Build a statement that's been kept in the optimized tree.
+	node_id emit(const statement& s, ast::tree& to)
+	{
+		if (s.target == symbol::none)
+		{
+			return copy(m_code, s.original, to);
+		}
+
+		auto children = m_code.children(s.original);
+		node_id rhs;
+		if (!s.value.has_value())
+		{
+			rhs = copy(m_scratch, s.rebuilt, to);
+		}
+		else if (auto folded = literal(*s.value, false))
+		{
+			rhs = add_literal(*folded, to);
+		}
+		else
+		{
+			rhs = copy(m_code, children[2], to);
+		}
+		node_id lhs	  = to.leaf(kind::identifier, m_code.text(children[0]));
+		node_id equal = copy(m_code, children[1], to);
+		return to.branch(kind::assignment, { lhs, equal, rhs }, m_code.text(s.original));
+	}
+
+	/**
+	 * @brief Update what's known now that the target's been assigned.
+	 *
+	 * @param expression The expression assigned, if its value isn't known, or no_expression.
+	 * @param dependencies The variables the expression reads.
+	 */
+	void assign(symbol::id target, const std::optional<variable>& value, node_id expression, const std::vector<symbol::id>& dependencies)
+	{
+		// Expressions that read the target, or were held by it, aren't available anymore.
+		for (node_id dependent : state(target).dependents)
+		{
+			m_available.erase(dependent);
+		}
+		for (node_id held : state(target).held)
+		{
+			if (auto found = m_available.find(held); found != m_available.end() && found->second == target)
+			{
+				m_available.erase(found);
+			}
+		}
+		state(target).dependents.clear();
+		state(target).held.clear();
+
+		state(target).known	   = value;
+		state(target).assigned = true;
+
+		// The target holds the expression's value, unless the expression read the target's old value.
+		if (expression == no_expression || m_available.count(expression) != 0 ||
+			std::find(dependencies.begin(), dependencies.end(), target) != dependencies.end())
+		{
+			return;
+		}
+		m_available.emplace(expression, target);
+		state(target).held.push_back(expression);
+		for (symbol::id dependency : dependencies)
+		{
+			state(dependency).dependents.push_back(expression);
+		}
+	}
+
+	/// Fold an operand, mirroring eval::operand, eval::expression and eval::arithmetic.
+	folded operand(node_id node)
+	{
+		switch (m_code.type(node))
+		{
+		case kind::identifier:
+		{
+			symbol::id sym = m_code.symbol(node);
+			if (state(sym).known.has_value())
+			{
+				++m_report.folded;
+				return { state(sym).known, ast::no_node };
+			}
+			m_reads.push_back(sym);
+			return { {}, m_scratch.leaf(kind::identifier, m_code.text(node)) };
+		}
+		case kind::expression:
+		{
+			auto children = m_code.children(node);
+			auto inner	  = std::find_if(children.begin(), children.end(), [this](node_id child) {
+				   return m_code.type(child) == kind::arithmetic;
+			   });
+			if (inner == children.end())
+			{
+				return { variable(), ast::no_node };
+			}
+			folded value = operand(*inner);
+			if (value.value.has_value())
+			{
+				return value;
+			}
+			std::vector<node_id> rebuilt;
+			for (node_id child : children)
+			{
+				rebuilt.push_back(child == *inner ? value.node : rebuild(child));
+			}
+			return { {}, m_scratch.branch(kind::expression, rebuilt, m_code.text(node)) };
+		}
+		case kind::arithmetic:
+		{
+			node_id lhs	 = m_code.children(node).at(0);
+			node_id oper = m_code.children(node).at(1);
+			node_id rhs	 = m_code.children(node).at(2);
+
+			folded left	 = operand(lhs);
+			folded right = operand(rhs);
+			if (left.value.has_value() && right.value.has_value())
+			{
+				++m_report.folded;
+				return { eval::binary(*left.value, m_code.text(oper), *right.value), ast::no_node };
+			}
+			return { {}, m_scratch.branch(kind::arithmetic, { materialize(lhs, left), rebuild(oper), materialize(rhs, right) }, m_code.text(node)) };
+		}
+		default:
+			return { variable(m_code, node), ast::no_node };
+		}
+	}
+
+	/// The folded operand's node, as a literal if its value is known, or as it was if that can't be written as one.
+	node_id materialize(node_id original, const folded& value)
+	{
+		if (!value.value.has_value())
+		{
+			return value.node;
+		}
+		if (auto folded = literal(*value.value, true))
+		{
+			return add_literal(*folded, m_scratch);
+		}
+		return rebuild(original);
+	}
+
+	/// Copy a subtree of the original into the scratch tree, reading every variable in it.
+	node_id rebuild(node_id node)
+	{
+		read_all(node);
+		return copy(m_code, node, m_scratch);
+	}
+
+	/// Add every variable in a subtree of the original to what the statement reads.
+	void read_all(node_id node)
+	{
+		if (m_code.type(node) == kind::identifier)
+		{
+			m_reads.push_back(m_code.symbol(node));
+		}
+		for (node_id child : m_code.children(node))
+		{
+			read_all(child);
+		}
+	}
+
+	/// Looking back from the end, drop assignments that are overwritten before they're read.
+	void remove_dead_stores()
+	{
+		// Variables whose values are overwritten before they're read, from the statement being looked at on.
+		std::vector<uint8_t> overwritten;
+		std::vector<symbol::id> marked;
+		auto mark = [&](symbol::id sym, bool value) {
+			if (sym >= overwritten.size())
+			{
+				overwritten.resize(sym + 1, false);
+			}
+			if (value && !overwritten[sym])
+			{
+				marked.push_back(sym);
+			}
+			overwritten[sym] = value;
+		};
+
+		for (auto s = m_statements.rbegin(); s != m_statements.rend(); ++s)
+		{
+			if (s->may_throw)
+			{
+				// Whatever was assigned before may be all that's left if this throws.
+				for (symbol::id sym : marked)
+				{
+					overwritten[sym] = false;
+				}
+				marked.clear();
+				continue;
+			}
+			if (s->target < overwritten.size() && overwritten[s->target])
+			{
+				s->kept = false;
+				++m_report.dead_stores;
+				continue;
+			}
+			mark(s->target, true);
+			for (size_t i = s->reads_begin; i < s->reads_end; ++i)
+			{
+				mark(m_reads[i], false);
+			}
+		}
+	}
+
+	name& state(symbol::id sym)
+	{
+		if (sym >= m_names.size())
+		{
+			m_names.resize(sym + 1);
+		}
+		return m_names[sym];
+	}
+
+	static constexpr node_id no_expression = ast::no_node;
+
+	const ast::tree& m_code;
+	ast::tree m_scratch;
+	stats& m_report;
+
+	std::vector<statement> m_statements;
+	/// The variables each statement reads, end to end.
+	std::vector<symbol::id> m_reads;
+	/// What's known about each variable, by symbol.
+	std::vector<name> m_names;
+	/// The variable holding each expression's value, by the expression's node in the scratch tree.
+	std::unordered_map<node_id, symbol::id> m_available;
+};
+
+ast::tree optimize(const ast::tree& code, stats* report)
+{
+	if (code.root() == ast::no_node)
+	{
+		return code;
+	}
+	stats ignored;
+	return pass(code, report ? *report : ignored).run();
+}
+
+}
@@ -1,6 +1,151 @@
 #include "output.hpp"
+#include <charconv>
+#include <cstdio>
 
-output::output(int verbosity)
-	: m_verbosity(verbosity)
+output::output(int verbosity, format style, bool async, std::ostream& sink)
+	: m_verbosity(verbosity),
+	  m_style(style),
+	  m_sink(sink),
+	  m_start(std::chrono::steady_clock::now()),
+	  m_writing(false),
+	  m_stopping(false)
 {
-}
\ No newline at end of file
+	m_buffer.reserve(buffer_size * 2);
+	if (async)
+	{
+		m_writer = std::thread(&output::write_loop, this);
+	}
+}
+
+output::~output()
+{
+	flush();
+	if (m_writer.joinable())
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_stopping = true;
+		}
+		m_wake.notify_one();
+		m_writer.join();
+	}
+}
+
+void output::error(std::string_view message)
+{
+	flush();
+	if (m_style == format::json)
+	{
+		std::unique_lock lock(m_mutex);
+		record(0, "error", message);
+		std::cerr << m_buffer << std::flush;
+		m_buffer.clear();
+	}
+	else
+	{
+		std::cerr << message << std::flush;
+	}
+}
+
+void output::flush()
+{
+	std::unique_lock lock(m_mutex);
+	drain(lock);
+	m_written.wait(lock, [this] { return m_pending.empty() && !m_writing; });
+}
+
+void output::record(int intended_verbosity, std::string_view field, std::string_view message)
+{
+	// Formatted by hand, since there can be millions of records and printf is slow.
+	auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start);
+	char number[24];
+	m_buffer += "{\"time\":";
+	m_buffer.append(number, std::to_chars(number, number + sizeof(number), time.count() / 1000000).ptr);
+	m_buffer += '.';
+	auto micros = std::to_string(1000000 + time.count() % 1000000);
+	m_buffer.append(micros, 1, 6);
+	m_buffer += ",\"level\":";
+	m_buffer.append(number, std::to_chars(number, number + sizeof(number), intended_verbosity).ptr);
+	m_buffer += ",\"";
+	m_buffer += field;
+	m_buffer += "\":\"";
+	for (size_t begin = 0, end; begin < message.size(); begin = end + 1)
+	{
+		// Copy everything up to the next character that needs escaping in one go.
+		end = begin;
+		while (end < message.size() && message[end] != '"' && message[end] != '\\' &&
+			   static_cast<unsigned char>(message[end]) >= 0x20)
+		{
+			++end;
+		}
+		m_buffer.append(message, begin, end - begin);
+		if (end == message.size())
+		{
+			break;
+		}
+
+		switch (char c = message[end])
+		{
+		case '"': m_buffer += "\\\""; break;
+		case '\\': m_buffer += "\\\\"; break;
+		case '\n': m_buffer += "\\n"; break;
+		case '\r': m_buffer += "\\r"; break;
+		case '\t': m_buffer += "\\t"; break;
+		default:
+			char escaped[8];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+			m_buffer += escaped;
+		}
+	}
+	m_buffer += "\"}\n";
+}
+
+void output::drain(std::unique_lock<std::mutex>& lock)
+{
+	if (m_buffer.empty())
+	{
+		return;
+	}
+	if (!m_writer.joinable())
+	{
+		m_sink << m_buffer << std::flush;
+		m_buffer.clear();
+		return;
+	}
+	// Don't let the writer fall too far behind.
+	m_written.wait(lock, [this] { return m_pending.size() < max_pending; });
+	if (m_pending.empty())
+	{
+		std::swap(m_pending, m_buffer);
+	}
+	else
+	{
+		m_pending += m_buffer;
+	}
+	m_buffer.clear();
+	m_wake.notify_one();
+}
+
+void output::write_loop()
+{
+	std::string writing;
+	std::unique_lock lock(m_mutex);
+	while (true)
+	{
+		m_wake.wait(lock, [this] { return !m_pending.empty() || m_stopping; });
+		if (m_pending.empty())
+		{
+			return;
+		}
+
+		// Write outside the lock, so messages keep being buffered meanwhile.
+		std::swap(writing, m_pending);
+		m_writing = true;
+		lock.unlock();
+		m_sink << writing << std::flush;
+		writing.clear();
+		lock.lock();
+		m_writing = false;
+		m_written.notify_all();
+	}
+}
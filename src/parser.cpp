@@ -1,8 +1,11 @@
 #include <algorithm>
+#include <exception>
 #include <iostream>
+#include <optional>
 #include <regex>
 #include <sstream>
 #include <stdexcept>
+#include <thread>
 #include <tuple>
 #include "parser.hpp"
 
@@ -22,12 +25,12 @@ tree_node& tree_node::add_child(tree_node node, size_t pos)
 	if (pos == -1)
 	{
 		node.m_index = m_children.size();
-		m_children.push_back(node);
+		m_children.push_back(std::move(node));
 		return m_children.back();
 	}
 	else
 	{
-		tree_node& inserted = *m_children.insert(m_children.cbegin() + pos, node);
+		tree_node& inserted = *m_children.insert(m_children.cbegin() + pos, std::move(node));
 		for (size_t i = 0; i < m_children.size(); ++i)
 		{
 			m_children[i].m_index = i;
@@ -74,12 +77,12 @@ size_t tree_node::size() const
 	return m_children.size();
 }
 
-std::string tree_node::type() const
+const std::string& tree_node::type() const
 {
 	return m_type;
 }
 
-std::string tree_node::value() const
+const std::string& tree_node::value() const
 {
 	return m_value;
 }
@@ -156,17 +159,46 @@ size_t tree_node::depth() const
 	return depth;
 }
 
+/// How many nodes a match term may consume.
+enum class quantifier
+{
+	one,		  ///< exactly one
+	one_or_more,  ///< +
+	any,		  ///< *
+	optional	  ///< ?
+};
+
 /**
- * @brief Returns true if the given tree node matches the given expression.
- * 
+ * @brief One alternative of a match expression, e.g. `operator;=` or `separator+`.
+ * Compiled once from the expression string, so matching doesn't have to parse anything.
+ */
+struct match_term
+{
+	std::string type;
+	/// Empty if any value is accepted.
+	std::string value;
+	/// If set, the node's value must differ from `value` instead.
+	bool negate_value;
+	quantifier quant;
+
+	/// Whether a single node satisfies this term's type and value.
+	bool matches(const tree_node& n) const
+	{
+		if (n.type() != type)
+			return false;
+		return value.empty() || ((n.value() == value) != negate_value);
+	}
+};
+
+/// A compiled match expression: its alternatives, tried in order.
+using matcher = std::vector<match_term>;
+
+/**
+ * @brief Compile a match expression string into its alternatives.
+ *
  * @param expr The non-compounded match expression
- * @param node The node to attempt to match against.
- * 
- * @return std::tuple<bool,int>
- * 	1 => matches or not
- * 	2 => amount of matches captured.
  */
-std::tuple<bool, int> does_match_expr(const std::string& expr, const tree_node& node)
+matcher compile_match_expr(const std::string& expr)
 {
 	// First, split expression at all logical or-s
 	std::vector<std::string> split = {};
@@ -185,113 +217,114 @@ std::tuple<bool, int> does_match_expr(const std::string& expr, const tree_node&
 	}
 	split.push_back(current);
 
-	// For
-	size_t captured_length = 0;
-
-	// clang-format off
-	// Test for any matching expression.
-	return { 
-		std::any_of(split.begin(),
-					split.end(),
-					[&node, &captured_length](const std::string& test) -> bool {
-						captured_length = 0;
-						//! Here we retrieve the requested node type and value.
-						std::string type;
-						std::string value;
-						bool negate_value = false;
-						type = value = "";
-						// Init name.
-						if (size_t split_pos = test.find(':'); split_pos != std::string::npos)
-						{
-							type  = test.substr(0, split_pos);
-							value = test.substr(split_pos + 1);
-						}
-						else if (size_t split_pos = test.find(';'); split_pos != std::string::npos)
-						{
-							type  = test.substr(0, split_pos);
-							value = test.substr(split_pos + 1);
-							negate_value = true;
-						}
-						else
-						{
-							type = test;
-						}
-						
-						//* Checks if a given node matches the test type/value.
-						auto matches = [&type, &value, &negate_value](const tree_node& n) -> bool{
-							bool success = n.type() == type;
-							if(value == "")
-								return success;
-							else
-								return success && ((n.value() == value) != negate_value);
-						};
-
-						if (type.back() == '+') //* Greedy regex operator +
-						{
-							type.pop_back();
-
-							// If not even one matches, it's false.
-							if (!matches(node))
-								return false;
-								
-							// Otherwise, we guarentee a length of one.
-							captured_length = 1;
-
-							// We now iterate over all following available nodes,
-							// until one doesn't match.
-							tree_node* next = node.next();
-							do
-							{	
-								if(!matches(*next)) break;
-								
-								captured_length++;
-							} while ((next = next->next()));
-							
-							return true;
-						}
-						else if (type.back() == '*' && type.size() > 1) //* Greedy regex-like operator *
-						{
-							type.pop_back();
-							
-							// Unknown how many captures left.
-							captured_length = 0;
-							
-							// Check the first node.
-							if(matches(node)) captured_length++;
-							
-							// Now we go through all following nodes, accumulating matching ones.
-							tree_node* next = node.next();
-							do
-							{
-								if(!matches(*next)) break;
-								
-								captured_length++;
-							} while((next = next->next()));
-							
-							return true; // 0 or more matches will return true always anyway.
-						}
-						else if (type.back() == '?') //* one or none.
-						{
-							type.pop_back();
-							
-							captured_length = (size_t)matches(node);
-							
-							return true;
-						}
-						else
-						{
-							// Types must match, and the value should match only if the value isn't empty.
-							if(matches(node))
-							{
-								captured_length = 1;
-								return true;
-							}
-							
-							return false;
-						}
-					}),
-			 captured_length };
-	// clang-format on
+	matcher compiled;
+	for (auto& test : split)
+	{
+		match_term term{ "", "", false, quantifier::one };
+		// Init name.
+		if (size_t split_pos = test.find(':'); split_pos != std::string::npos)
+		{
+			term.type  = test.substr(0, split_pos);
+			term.value = test.substr(split_pos + 1);
+		}
+		else if (size_t split_pos = test.find(';'); split_pos != std::string::npos)
+		{
+			term.type		  = test.substr(0, split_pos);
+			term.value		  = test.substr(split_pos + 1);
+			term.negate_value = true;
+		}
+		else
+		{
+			term.type = test;
+		}
+
+		if (term.type.back() == '+')
+		{
+			term.quant = quantifier::one_or_more;
+		}
+		else if (term.type.back() == '*' && term.type.size() > 1)
+		{
+			term.quant = quantifier::any;
+		}
+		else if (term.type.back() == '?')
+		{
+			term.quant = quantifier::optional;
+		}
+		if (term.quant != quantifier::one)
+		{
+			term.type.pop_back();
+		}
+		compiled.push_back(std::move(term));
+	}
+	return compiled;
+}
+
+/**
+ * @brief Returns true if the given tree node matches the given compiled expression.
+ * 
+ * @param expr The compiled, non-compounded match expression
+ * @param program The node whose children are being matched.
+ * @param begin The index of the child to attempt to match against.
+ * @param extent Raised to one past the last child examined, or -1 if the end of the program was reached.
+ * 
+ * @return std::tuple<bool,int>
+ * 	1 => matches or not
+ * 	2 => amount of matches captured.
+ */
+std::tuple<bool, int> does_match_expr(const matcher& expr, const tree_node& program, size_t begin, size_t& extent)
+{
+	const tree_node& node = program[begin];
+	// Greedy terms read until the first node that doesn't match.
+	auto examined = [&program, &extent](size_t next) {
+		extent = std::max(extent, next < program.size() ? next + 1 : -1);
+	};
+	extent = std::max(extent, begin + 1);
+
+	// Test for any matching alternative.
+	for (auto& term : expr)
+	{
+		switch (term.quant)
+		{
+		case quantifier::one_or_more: //* Greedy regex operator +
+		{
+			// If not even one matches, it's false.
+			if (!term.matches(node))
+				continue;
+
+			// We now iterate over all following available nodes,
+			// until one doesn't match.
+			size_t captured_length = 1;
+			size_t next			   = begin + 1;
+			for (; next < program.size() && term.matches(program[next]); ++next)
+			{
+				captured_length++;
+			}
+			examined(next);
+			return { true, captured_length };
+		}
+		case quantifier::any: //* Greedy regex-like operator *
+		{
+			// 0 or more matches will return true always anyway.
+			size_t captured_length = 0;
+			size_t next			   = begin;
+			for (; next < program.size() && term.matches(program[next]); ++next)
+			{
+				captured_length++;
+			}
+			examined(next);
+			return { true, captured_length };
+		}
+		case quantifier::optional: //* one or none.
+			return { true, (int)term.matches(node) };
+		case quantifier::one:
+			// Types must match, and the value should match only if the value isn't empty.
+			if (term.matches(node))
+				return { true, 1 };
+			break;
+		}
+	}
+
+	return { false, 0 };
 }
 
 /**
@@ -305,6 +338,8 @@ struct parse_node
 	std::string type;
 	/// The parse node match expression
 	std::vector<std::string> match_expr;
+	/// The match expression, compiled once on construction.
+	std::vector<matcher> compiled;
 	/// If there's no match expression, there'll just be a simple regex.
 	std::regex regex;
 	/// Minimum depth into the parent node to be considered.
@@ -314,6 +349,10 @@ struct parse_node
 	parse_node(std::string type, std::initializer_list<std::string> match_expr, int layer = 0)
 		: type(type), match_expr(match_expr), layer(layer)
 	{
+		for (auto& expr : this->match_expr)
+		{
+			compiled.push_back(compile_match_expr(expr));
+		}
 	}
 
 	parse_node(std::string type, std::string match_expr, int layer = 0)
@@ -325,51 +364,48 @@ struct parse_node
 	 * @brief Attempt to match the next set of tokens with this parse node's
 	 * 
 	 * @param program The base tree node to find the expression 
-	 * @return std::tuple<bool, int>
 	 * @param begin Where to begin in the program tree.
+	 * @param extent Set to one past the last child examined, or -1 if the result depends on where the program ends.
+	 * @return std::tuple<bool, int>
 	 * 	1 => success
 	 * 	2 => length of match, in tokens to consume.
-	 * 	3 => all matched nodes
 	 */
-	std::tuple<bool, int, std::vector<tree_node>> try_match(const tree_node& program, size_t begin = 0) const
+	std::tuple<bool, int> try_match(const tree_node& program, size_t begin, size_t& extent) const
 	{
+		extent = begin + 1;
 		//* First, check if there's no match expr, and it's just a regex.
 		if (match_expr.size() == 0)
 		{
 			const tree_node& node = program[begin];
 			if (std::regex_match(node.value(), regex))
 			{
-				return {
-					true, 1, program.child_slice(begin, begin + 1)
-				};
+				return { true, 1 };
 			}
 			else
 			{
-				return { false, -1, {} };
+				return { false, -1 };
 			}
 		}   // now it's defs not a regex expression.
 
 		// Iterate over all match criteria
 		size_t token_length_sum = 0;
-		for (size_t i = 0; i < match_expr.size(); ++i)
+		for (auto& expr : compiled)
 		{
-			// Get the active match expr.
-			std::string expr = match_expr[i];
 			// Get active node
-			if (token_length_sum + begin >= program.size()) return { false, -1, {} };
-			const tree_node& node = program[token_length_sum + begin];
-
-			auto [success, length] = does_match_expr(expr, node);
+			if (token_length_sum + begin >= program.size())
+			{
+				extent = -1;
+				return { false, -1 };
+			}
+			auto [success, length] = does_match_expr(expr, program, token_length_sum + begin, extent);
 			if (!success)
 			{
-				return { false, -1, {} };
+				return { false, -1 };
 			}
 			token_length_sum += length;
 		}
 		// If here, successful match.
-		return {
-			true, token_length_sum, program.child_slice(begin, begin + token_length_sum)
-		};
+		return { true, token_length_sum };
 	}
 };
 
@@ -392,7 +428,7 @@ struct parse_node
  * @brief All available compound expression matchers.
  * 
  */
-static std::vector<parse_node> expressions = {
+static const std::vector<parse_node> expressions = {
 	parse_node("arithmetic", { "identifier|number|string", "operator;=", "identifier|number|string" }),
 	parse_node("assignment", { "identifier", "operator:=", "number|string|identifier|expression|arithmetic" }),
 	parse_node("nop", { "separator+" }),
@@ -403,9 +439,9 @@ static std::vector<parse_node> expressions = {
  * @brief Get the expression with the given type.
  * 
  * @param type The expression type.
- * @return parse_node& The parse node associated with that expression type.
+ * @return const parse_node& The parse node associated with that expression type.
  */
-parse_node& get_expression(std::string type)
+const parse_node& get_expression(std::string type)
 {
 	auto found = std::find_if(expressions.begin(),
 							  expressions.end(),
@@ -424,78 +460,505 @@ parse_node& get_expression(std::string type)
 }
 
 /**
- * @brief Iterate through the whole program recursively until no more changes are made.
+ * @brief Packrat memo for the rewrite engine, remembering every rule's match at every position.
+ *
+ * An entry stays valid for as long as the nodes it examined are untouched. Rewrites
+ * keep every node before the first match where it was, so a rewrite only forgets the
+ * entries that looked at or past that point.
+ */
+class packrat
+{
+public:
+	packrat(size_t rules, memo_stats& stats)
+		: m_table(rules), m_stats(stats)
+	{
+	}
+
+	/// Match rule `rule` at `begin`, reusing the memoized result if it's still valid.
+	std::tuple<bool, int> match(size_t rule, const tree_node& program, size_t begin)
+	{
+		std::vector<entry>& table = m_table[rule];
+		if (begin < table.size() && table[begin].valid)
+		{
+			m_stats.hits++;
+			return { table[begin].success, table[begin].length };
+		}
+
+		m_stats.misses++;
+		if (begin >= table.size())
+		{
+			table.resize(begin + 1);
+		}
+		entry& e = table[begin];
+		std::tie(e.success, e.length) = expressions[rule].try_match(program, begin, e.extent);
+		e.valid = true;
+		return { e.success, e.length };
+	}
+
+	/// Forget every entry that examined a node at or after `first_changed`.
+	void invalidate(size_t first_changed)
+	{
+		for (auto& table : m_table)
+		{
+			if (table.size() > first_changed)
+			{
+				table.resize(first_changed);
+			}
+			for (auto& e : table)
+			{
+				e.valid = e.valid && e.extent <= first_changed;
+			}
+		}
+	}
+
+private:
+	struct entry
+	{
+		bool valid = false;
+		bool success;
+		int length;
+		/// One past the last node examined.
+		size_t extent;
+	};
+
+	/// Entries by rule, then by position.
+	std::vector<std::vector<entry>> m_table;
+	memo_stats& m_stats;
+};
+
+/**
+ * @brief Iterate through the whole program until no more changes are made.
  * Updates chains of tokens / parse nodes with higher level parse nodes.
  * 
  * @param program The base program. 
+ * @param memo The memo to match rules through.
+ */
+tree_node run_through(tree_node program, packrat& memo)
+{
+	bool changed;
+	do
+	{
+		changed = false;
+		// For every expression type...
+		for (size_t rule = 0; rule < expressions.size(); ++rule)
+		{
+			// Resulting tree_node, only built once something matches.
+			tree_node result(program.type(), program.value());
+			// Where the first match is, once there is one.
+			std::optional<size_t> first_changed;
+
+			// Iterate over all tokens,
+			for (size_t i = 0; i < program.size();)
+			{
+				// Attempt to match the current set of tokens with the current expression.
+				auto [success,   // Whether or not it was a successful match.
+					  length] =  // The length of the successful match
+					memo.match(rule, program, i);
+
+				if (success)
+				{
+					if (!first_changed)
+					{
+						// Everything before is unchanged, move it over.
+						first_changed = i;
+						for (size_t j = 0; j < i; ++j)
+						{
+							result.add_child(std::move(program[j]));
+						}
+					}
+
+					// Append a new child, and move the matched nodes into it.
+					tree_node& new_node = result.add_child({ expressions[rule].type, "" });
+					for (size_t j = i; j < i + length; ++j)
+					{
+						new_node.add_child(std::move(program[j]));
+					}
+
+					i += length;
+				}
+				else
+				{
+					if (first_changed)
+					{
+						result.add_child(std::move(program[i]));
+					}
+					i++;
+				}
+			}
+
+			if (first_changed)
+			{
+				program = std::move(result);
+				memo.invalidate(*first_changed);
+				changed = true;
+			}
+		}
+	} while (changed);
+
+	return program;
+}
+
+//! PRATT PARSER
+
+/**
+ * @brief Parses a token list in a single pass, building the same nodes as `expressions`.
+ *
+ * Statements are tried in the order the rewrite engine would match them. Whatever
+ * doesn't parse is left in the program as a plain token, and parsing resumes at the
+ * next token, just like the rewrite engine leaves unmatched nodes alone.
  */
-tree_node run_through(const tree_node& program)
+class pratt_parser
 {
-	tree_node initial(program);
-	// Resulting tree_node.
-	tree_node result(program.type(), program.value());
+public:
+	/// How deep parentheses may nest before parsing gives up.
+	static constexpr size_t max_depth = 1024;
+
+	/**
+	 * @brief Initialize the parser over the tokens in [begin, end), adding their nodes to the given tree.
+	 *
+	 * @remarks Parsing stops at end as if the program ended there, so it should be the start of a statement.
+	 */
+	pratt_parser(const std::vector<lexer::token>& tokens, size_t begin, size_t end, ast::tree& tree)
+		: m_tokens(tokens), m_tree(tree), m_begin(begin), m_end(end), m_pos(begin), m_depth(0),
+		  m_no_primary(end - begin, false)
+	{
+	}
+
+	/// Parse every statement in the range, without putting them under an entry node.
+	std::vector<ast::node_id> parse_statements()
+	{
+		std::vector<ast::node_id> statements;
+		while (m_pos < m_end)
+		{
+			statements.push_back(statement());
+		}
+		return statements;
+	}
 
-	// For every expression type...
-	for (auto& expr : expressions)
+private:
+	/// Parse the statement at the cursor. Always consumes at least one token.
+	ast::node_id statement()
 	{
-		// Iterate over all tokens,
-		for (size_t i = 0; i < initial.size();)
+		const lexer::token& tok = m_tokens[m_pos];
+
+		// Runs of separators.
+		if (tok.kind == lexer::token_kind::separator)
 		{
-			// Attempt to match the current set of tokens with the current expression.
-			auto [success,   // Whether or not it was a successful match.
-				  length,	// The length of the successful match
-				  toks] =	// The matched tokens, to be moved as a child of the new node.
-				expr.try_match(initial, i);
+			std::vector<ast::node_id> separators;
+			while (m_pos < m_end && m_tokens[m_pos].kind == lexer::token_kind::separator)
+			{
+				separators.push_back(leaf(m_pos++));
+			}
+			return m_tree.branch(ast::kind::nop, separators);
+		}
 
-			if (success)
+		// identifier = expression
+		if (tok.kind == lexer::token_kind::identifier && is_operator(m_pos + 1, "="))
+		{
+			auto mark		   = m_tree.mark();
+			size_t begin	   = m_pos;
+			ast::node_id lhs   = leaf(m_pos++);
+			ast::node_id equal = leaf(m_pos++);
+			if (ast::node_id rhs = expression(0); rhs != ast::no_node)
 			{
-				// Append a new child.
-				tree_node& new_node = result.add_child({ expr.type, "" });
+				return m_tree.branch(ast::kind::assignment, { lhs, equal, rhs });
+			}
+			m_tree.rewind(mark);
+			m_pos = begin;
+		}
+
+		// A lone expression.
+		if (ast::node_id expr = expression(0); expr != ast::no_node)
+		{
+			return expr;
+		}
+
+		// Anything else is left as it is.
+		return leaf(m_pos++);
+	}
 
-				// Iterate over all sub-matched tokens, and add them to the new child.
-				for (size_t i = 0; i < length; ++i)
+	/**
+	 * @brief Parse an expression at the cursor, only consuming operators that bind tighter than min_precedence.
+	 *
+	 * @remarks A trailing operator with no operand after it is left unconsumed.
+	 * @return ast::node_id The expression, or ast::no_node if there isn't one.
+	 */
+	ast::node_id expression(int min_precedence)
+	{
+		ast::node_id lhs = primary();
+		if (lhs == ast::no_node)
+		{
+			return ast::no_node;
+		}
+
+		for (int prec = precedence(); prec > min_precedence; prec = precedence())
+		{
+			auto mark		 = m_tree.mark();
+			size_t op_pos	= m_pos;
+			ast::node_id op  = leaf(m_pos++);
+			ast::node_id rhs = expression(prec);
+			if (rhs == ast::no_node)
+			{
+				m_tree.rewind(mark);
+				m_pos = op_pos;
+				break;
+			}
+
+			lhs = m_tree.branch(ast::kind::arithmetic, { lhs, op, rhs });
+		}
+
+		return lhs;
+	}
+
+	/// Parse a literal, an identifier or a parenthesized expression.
+	ast::node_id primary()
+	{
+		if (m_pos >= m_end || m_no_primary[m_pos - m_begin])
+		{
+			return ast::no_node;
+		}
+
+		const lexer::token& tok = m_tokens[m_pos];
+		switch (tok.kind)
+		{
+		case lexer::token_kind::identifier:
+		case lexer::token_kind::number:
+		case lexer::token_kind::string:
+			return leaf(m_pos++);
+		case lexer::token_kind::parens:
+			if (tok.text == "(")
+			{
+				if (m_depth == max_depth)
 				{
-					new_node.add_child(toks[i]);
+					throw std::runtime_error("Parentheses are nested more than " + std::to_string(max_depth) + " levels deep.");
 				}
+				auto mark		   = m_tree.mark();
+				size_t begin	   = m_pos;
+				ast::node_id open  = leaf(m_pos++);
+				++m_depth;
+				ast::node_id inner = expression(0);
+				--m_depth;
+				if (inner != ast::no_node && is_parens(m_pos, ")"))
+				{
+					return m_tree.branch(ast::kind::expression, { open, inner, leaf(m_pos++) });
+				}
+				// Whether a primary parses only depends on where it starts,
+				// so remembering failures keeps unbalanced parentheses linear.
+				m_no_primary[begin - m_begin] = true;
+				m_tree.rewind(mark);
+				m_pos = begin;
+			}
+			return ast::no_node;
+		default:
+			return ast::no_node;
+		}
+	}
+
+	/// The binding power of the binary operator at the cursor, or 0 if there isn't one.
+	int precedence() const
+	{
+		if (m_pos >= m_end || m_tokens[m_pos].kind != lexer::token_kind::oper)
+		{
+			return 0;
+		}
+		std::string_view op = m_tokens[m_pos].text;
+		if (op == "*" || op == "/")
+		{
+			return 2;
+		}
+		if (op == "+" || op == "-")
+		{
+			return 1;
+		}
+		return 0;
+	}
 
-				i += length;
+	bool is_operator(size_t i, std::string_view op) const
+	{
+		return i < m_end && m_tokens[i].kind == lexer::token_kind::oper && m_tokens[i].text == op;
+	}
+
+	bool is_parens(size_t i, std::string_view p) const
+	{
+		return i < m_end && m_tokens[i].kind == lexer::token_kind::parens && m_tokens[i].text == p;
+	}
+
+	ast::node_id leaf(size_t i)
+	{
+		return m_tree.leaf(m_tokens[i]);
+	}
+
+	const std::vector<lexer::token>& m_tokens;
+	ast::tree& m_tree;
+	/// The range of tokens being parsed.
+	size_t m_begin;
+	size_t m_end;
+	size_t m_pos;
+	/// How many parentheses the cursor is inside.
+	size_t m_depth;
+	/// Positions known not to start a primary expression, from m_begin.
+	std::vector<bool> m_no_primary;
+};
+
+/// Copy a tree built by the rewrite engine into the flat form.
+ast::node_id flatten(const tree_node& node, ast::tree& into)
+{
+	std::optional<ast::kind> type = ast::kind_of(node.type());
+	if (!type)
+	{
+		throw std::runtime_error("Unknown node type " + node.type() + ".");
+	}
+	if (node.size() == 0 && *type != ast::kind::nop)
+	{
+		return into.leaf(*type, node.value());
+	}
+
+	std::vector<ast::node_id> children;
+	for (auto& child : node.children())
+	{
+		children.push_back(flatten(child, into));
+	}
+	return into.branch(*type, children, *type == ast::kind::entry ? "entry" : "");
+}
+
+/**
+ * @brief Find where to split the tokens into pieces that can be parsed on their own.
+ *
+ * A statement that doesn't start with a separator never consumes one, so every run of
+ * separators starts a statement, whatever came before it.
+ *
+ * @return std::vector<size_t> The start of each piece, the first being 0.
+ */
+std::vector<size_t> find_splits(const std::vector<lexer::token>& tokens, size_t jobs)
+{
+	auto is_separator = [&tokens](size_t i) {
+		return tokens[i].kind == lexer::token_kind::separator;
+	};
+
+	std::vector<size_t> splits = { 0 };
+	for (size_t i = 1; i < jobs; ++i)
+	{
+		size_t split = std::max(tokens.size() * i / jobs, splits.back() + 1);
+		while (split < tokens.size() && !(is_separator(split) && !is_separator(split - 1)))
+		{
+			++split;
+		}
+		if (split >= tokens.size())
+		{
+			break;
+		}
+		splits.push_back(split);
+	}
+	return splits;
+}
+
+/// Parse the statements between separators on several threads, and splice them under one entry node.
+ast::tree parse_parallel(const std::vector<lexer::token>& tokens, const options& opts)
+{
+	std::vector<size_t> splits = find_splits(tokens, opts.jobs);
+	splits.push_back(tokens.size());
+
+	size_t count = splits.size() - 1;
+	std::vector<ast::tree> trees(count, ast::tree(opts.hash_cons));
+	std::vector<std::vector<ast::node_id>> statements(count);
+	std::vector<std::exception_ptr> errors(count);
+
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < count; ++i)
+	{
+		threads.emplace_back([&, i] {
+			try
+			{
+				statements[i] = pratt_parser(tokens, splits[i], splits[i + 1], trees[i]).parse_statements();
 			}
-			else
+			catch (...)
 			{
-				result.add_child(initial[i]);
-				i++;
+				errors[i] = std::current_exception();
 			}
+		});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	// The first error in the program is the one the serial parser would have thrown.
+	for (auto& error : errors)
+	{
+		if (error)
+		{
+			std::rethrow_exception(error);
 		}
-		initial = result;
-		result  = tree_node(result.type(), result.value());
 	}
 
-	// If nothing changed, we can stop recursing.
-	if (initial == program)
+	// Pieces are joined in order, so every node gets the id the serial parser would give it.
+	ast::tree flat;
+	std::vector<ast::node_id> entry;
+	if (opts.hash_cons)
 	{
-		return initial;
+		// Sharing nodes across pieces means hash-consing them again, one at a time.
+		flat  = std::move(trees[0]);
+		entry = std::move(statements[0]);
+		for (size_t i = 1; i < count; ++i)
+		{
+			std::vector<ast::node_id> ids = flat.append(trees[i]);
+			for (ast::node_id id : statements[i])
+			{
+				entry.push_back(ids[id]);
+			}
+		}
 	}
 	else
 	{
-		// Otherwise, there's still more to run through, recurse deeper.
-		return run_through(initial);
+		auto [joined, bases] = ast::tree::concat(trees);
+		flat				 = std::move(joined);
+		for (size_t i = 0; i < count; ++i)
+		{
+			for (ast::node_id id : statements[i])
+			{
+				entry.push_back(bases[i] + id);
+			}
+		}
 	}
+	flat.set_root(flat.branch(ast::kind::entry, entry, "entry"));
+	return flat;
+}
+
+std::vector<ast::node_id> parse_into(ast::tree& tree, const std::vector<lexer::token>& tokens)
+{
+	return pratt_parser(tokens, 0, tokens.size(), tree).parse_statements();
 }
 
-tree_node parse(std::vector<lexer::token> tokens)
+ast::tree parse(const std::vector<lexer::token>& tokens, const options& opts, memo_stats* stats)
 {
+	if (opts.method == engine::pratt)
+	{
+		if (opts.jobs > 1 && tokens.size() >= opts.parallel_threshold)
+		{
+			return parse_parallel(tokens, opts);
+		}
+		ast::tree tree(opts.hash_cons);
+		std::vector<ast::node_id> statements = parse_into(tree, tokens);
+		tree.set_root(tree.branch(ast::kind::entry, statements, "entry"));
+		return tree;
+	}
+
 	/// Program's entry point.
 	tree_node program("entry", "entry");
 	/// Initialize the tree with the initial tokens
 	for (auto& tok : tokens)
 	{
-		program.add_child(tree_node(tok.type, tok.value));
+		program.add_child(tree_node(tok.type(), tok.value()));
 	}
 
-	program = run_through(program);
+	memo_stats local;
+	packrat memo(expressions.size(), stats != nullptr ? *stats : local);
+	program = run_through(std::move(program), memo);
 
-	return program;
+	ast::tree flat(opts.hash_cons);
+	flat.set_root(flatten(program, flat));
+	return flat;
 }
 
 
-}
\ No newline at end of file
+}
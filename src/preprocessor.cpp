@@ -1,45 +1,291 @@
-#include <regex>
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+#include "batch.hpp"
+#include "cache.hpp"
 #include "preprocessor.hpp"
 
 namespace preprocessor
 {
 
-std::string preprocess(const std::string& in)
+/// Get the canonical form of a path, for telling whether two imports are the same file.
+std::string canonical_path(const std::filesystem::path& path)
 {
-	// Move the code into an iss.
-	std::istringstream iss(in);
-	// Final return string.
-	std::string ret;
+	return std::filesystem::weakly_canonical(path).string();
+}
+
+/**
+ * @brief Check if the token at i begins an import directive: `import "path"`
+ * at the start of a statement, and followed by the end of one.
+ */
+bool is_import(const std::vector<lexer::token>& tokens, size_t i)
+{
+	auto ends_statement = [&tokens](size_t n) {
+		return n >= tokens.size() || tokens[n].kind == lexer::token_kind::separator;
+	};
+
+	return tokens[i].kind == lexer::token_kind::identifier &&
+		   (tokens[i].stripped ? tokens[i].value() == "import" : tokens[i].text == "import") &&
+		   i + 1 < tokens.size() &&
+		   tokens[i + 1].kind == lexer::token_kind::string &&
+		   (i == 0 || ends_statement(i - 1)) &&
+		   ends_statement(i + 2);
+}
+
+/// Hash a file a chunk at a time, dropping each chunk from memory once it's been read.
+uint64_t hash_file(const source& file)
+{
+	cache::hasher hasher;
+	for (size_t begin = 0, end; begin < file.size(); begin = end)
+	{
+		end = file.chunk_end(begin);
+		hasher.update(file.view().substr(begin, end - begin));
+		file.release(begin, end);
+	}
+	return hasher.digest();
+}
+
+loader::loader(std::string cache_dir, size_t jobs)
+	: m_cache_dir(cache_dir), m_jobs(jobs)
+{
+}
+
+std::unique_ptr<module> loader::load_module(const std::string& path, size_t jobs) const
+{
+	auto mod	= std::make_unique<module>();
+	mod->path	= path;
+	mod->file	= std::make_unique<source>(path);
+	mod->hash	= 0;
+	mod->cached = false;
+	source& file = *mod->file;
+	if (!file)
+	{
+		throw std::runtime_error("Could not open " + path + " for reading!");
+	}
+
+	if (!m_cache_dir.empty())
+	{
+		mod->hash = hash_file(file);
+		if (auto tokens = cache::load_tokens(m_cache_dir, mod->hash, file.view()); tokens.has_value())
+		{
+			mod->tokens = std::move(tokens.value());
+			mod->cached = true;
+		}
+	}
+
+	if (!mod->cached)
+	{
+		// Stream the file through the lexer a chunk at a time, the same way.
+		lexer::chunked_lexer lexer(jobs);
+		for (size_t begin = 0, end; begin < file.size(); begin = end)
+		{
+			end = file.chunk_end(begin);
+			lexer.feed(file.view().substr(0, end));
+			file.release(begin, end);
+		}
+		mod->tokens = lexer.finish(file.view());
+
+		if (!m_cache_dir.empty())
+		{
+			cache::store_tokens(m_cache_dir, mod->hash, file.view(), mod->tokens);
+		}
+	}
+
+	// Resolve the imports relative to this file.
+	std::filesystem::path dir = std::filesystem::path(path).parent_path();
+	for (size_t i = 0; i < mod->tokens.size(); ++i)
+	{
+		if (is_import(mod->tokens, i))
+		{
+			std::string quoted			   = mod->tokens[i + 1].value();
+			std::filesystem::path imported = dir / quoted.substr(1, quoted.size() - 2);
+			mod->imports.push_back({ i, imported.string(), canonical_path(imported) });
+		}
+	}
+
+	return mod;
+}
+
+std::vector<lexer::token> loader::load(const std::string& path)
+{
+	std::string entry = canonical_path(path);
+	m_entry			  = entry;
+
+	// Load the program a layer of imports at a time, every file in a layer at once.
+	std::vector<std::string> layer = { entry };
+	while (!layer.empty())
+	{
+		// Files are spread over the threads, so only a file loaded alone is lexed on more than one.
+		std::vector<std::unique_ptr<module>> loaded(layer.size());
+		size_t lex_jobs = layer.size() > 1 ? 1 : m_jobs;
+		batch::for_each(layer.size(), m_jobs, [&](size_t index, size_t) {
+			loaded[index] = load_module(layer[index], lex_jobs);
+		});
+
+		std::set<std::string> next;
+		for (auto& mod : loaded)
+		{
+			for (auto& import : mod->imports)
+			{
+				if (m_modules.count(import.canonical) == 0 &&
+					std::find(layer.begin(), layer.end(), import.canonical) == layer.end())
+				{
+					next.insert(import.canonical);
+				}
+			}
+			m_modules[mod->path] = std::move(mod);
+		}
+		layer.assign(next.begin(), next.end());
+	}
+
+	std::vector<lexer::token> program;
+	std::set<std::string> spliced;
+	splice(*m_modules.at(entry), program, spliced);
+	return program;
+}
+
+bool loader::splice(const module& mod, std::vector<lexer::token>& program, std::set<std::string>& spliced) const
+{
+	spliced.insert(mod.path);
+
+	auto import = mod.imports.begin();
+	for (size_t i = 0; i < mod.tokens.size(); ++i)
+	{
+		if (import != mod.imports.end() && import->index == i)
+		{
+			// Replace the directive with the imported file, unless it's already been spliced in.
+			if (spliced.count(import->canonical) == 0 &&
+				!splice(*m_modules.at(import->canonical), program, spliced))
+			{
+				return false;
+			}
+			++import;
+			++i;
+			continue;
+		}
+
+		program.push_back(mod.tokens[i]);
+		if (mod.tokens[i].kind == lexer::token_kind::error)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+const std::map<std::string, std::unique_ptr<module>>& loader::modules() const
+{
+	return m_modules;
+}
 
-	// Remove all trailing content after a # indicator.
-	bool in_string = false;   // To ignore comments inside strings.
-	for (std::string line; std::getline(iss, line);)
+bool loader::caching() const
+{
+	return !m_cache_dir.empty();
+}
+
+std::tuple<std::string, size_t, size_t> loader::locate(const lexer::token& tok) const
+{
+	for (auto& [path, mod] : m_modules)
 	{
-		bool comment_found = false;
-		// Iterate over all line chars.
-		for (size_t i = 0; i < line.size(); ++i)
+		std::string_view code = mod->file->view();
+		if (tok.text.data() >= code.data() && tok.text.data() <= code.data() + code.size())
 		{
-			char ch = line[i];
+			auto [line, column] = mod->file->position(tok.text.data() - code.data());
+			return { path, line, column };
+		}
+	}
+	return { "", 0, 0 };
+}
+
+//! PARSE TREE CACHE
+
+uint64_t tree_variant(const parser::options& opts, bool optimized)
+{
+	return (uint64_t)opts.method | (uint64_t)opts.hash_cons << 8 | (uint64_t)optimized << 16;
+}
+
+uint64_t loader::tree_key(const std::string& entry, uint64_t hash, uint64_t variant) const
+{
+	cache::hasher hasher;
+	uint64_t fields[] = { cache::tree_version, hash, variant };
+	hasher.update(std::string_view(reinterpret_cast<const char*>(fields), sizeof(fields)));
+	hasher.update(entry);
+	return hasher.digest();
+}
 
-			if (ch == '"' && i > 0 && line[i - 1] != '\\')
+std::optional<ast::tree> loader::load_tree(const std::string& path, uint64_t variant) const
+{
+	if (m_cache_dir.empty())
+	{
+		return {};
+	}
+
+	std::string entry = canonical_path(path);
+	source file(entry);
+	if (!file)
+	{
+		return {};
+	}
+	uint64_t hash = hash_file(file);
+
+	auto cached = cache::load_tree(m_cache_dir, tree_key(entry, hash, variant));
+	if (!cached.has_value() ||
+		cached->dependencies.empty() ||
+		cached->dependencies[0].path != entry ||
+		cached->dependencies[0].hash != hash)
+	{
+		return {};
+	}
+
+	// The tree is stale if any file it was parsed from changed, or an import would now resolve elsewhere.
+	for (auto& dependency : cached->dependencies)
+	{
+		if (dependency.path != entry)
+		{
+			source imported(dependency.path);
+			if (!imported || hash_file(imported) != dependency.hash)
 			{
-				in_string = !in_string;
+				return {};
 			}
-			else if (!in_string && ch == '#')
+		}
+		for (auto& [imported, canonical] : dependency.imports)
+		{
+			if (canonical_path(imported) != canonical)
 			{
-				ret += line.substr(0, i);
-				comment_found = true;
-				break;
+				return {};
 			}
 		}
+	}
+	return std::move(cached->tree);
+}
 
-		if (!comment_found)
+void loader::store_tree(const ast::tree& tree, uint64_t variant) const
+{
+	if (m_cache_dir.empty() || m_modules.count(m_entry) == 0)
+	{
+		return;
+	}
+
+	// The entry file goes first.
+	std::vector<cache::dependency> dependencies;
+	const module& entry = *m_modules.at(m_entry);
+	dependencies.push_back({ entry.path, entry.hash, {} });
+	for (auto& [path, mod] : m_modules)
+	{
+		if (path != m_entry)
+		{
+			dependencies.push_back({ mod->path, mod->hash, {} });
+		}
+	}
+	for (auto& dependency : dependencies)
+	{
+		for (auto& import : m_modules.at(dependency.path)->imports)
 		{
-			ret += line;
+			dependency.imports.push_back({ import.path, import.canonical });
 		}
 	}
 
-	return ret;
+	cache::store_tree(m_cache_dir, tree_key(entry.path, entry.hash, variant), dependencies, tree);
 }
 
 }
\ No newline at end of file
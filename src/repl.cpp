@@ -0,0 +1,84 @@
+#include "repl.hpp"
+#include <stdexcept>
+#include "lexer.hpp"
+#include "scan.hpp"
+
+namespace repl
+{
+
+session::session(interpreter::engine& engine, bool hash_cons)
+	: m_engine(engine), m_program(hash_cons)
+{
+}
+
+std::vector<ast::node_id> session::feed(const std::string& line)
+{
+	// Lines never end mid-statement, since neither strings nor parentheses can span a separator.
+	// The lexer matches the first token of its input as is, so skip the indent first, as it does after a separator.
+	std::string_view code = line;
+	std::vector<lexer::token> tokens = lexer::lex(code.substr(scan::skip_blank(code, 0)));
+	if (!tokens.empty() && tokens.back().kind == lexer::token_kind::error)
+	{
+		// Tokens view into the line, so the column counts the indent too.
+		size_t column = tokens.back().text.data() - line.data() + 1;
+		throw std::runtime_error("Lexer failed at column " + std::to_string(column) + ".\nError: " + tokens.back().value());
+	}
+
+	auto mark = m_program.mark();
+	std::vector<ast::node_id> statements;
+	try
+	{
+		statements = parser::parse_into(m_program, tokens);
+	}
+	catch (std::runtime_error& e)
+	{
+		m_program.rewind(mark);
+		throw std::runtime_error("Parser failed.\nError: " + std::string(e.what()));
+	}
+	m_statements.insert(m_statements.end(), statements.begin(), statements.end());
+	m_engine.resolve(m_program, m_slots);
+
+	for (ast::node_id statement : statements)
+	{
+		m_engine.execute(m_program, m_slots, statement);
+	}
+	return statements;
+}
+
+void session::run(std::istream& in, std::ostream& out)
+{
+	std::string line;
+	while (out << "> " << std::flush, std::getline(in, line))
+	{
+		try
+		{
+			for (ast::node_id statement : feed(line))
+			{
+				if (m_program.type(statement) != ast::kind::assignment)
+				{
+					continue;
+				}
+				ast::node_id name			 = m_program.children(statement)[0];
+				const interpreter::variable& value = m_engine.state().value(m_slots[name]);
+				out << m_program.text(name) << ": " << value.type() << " = " << value.value() << std::endl;
+			}
+		}
+		catch (std::runtime_error& e)
+		{
+			out << e.what() << std::endl;
+		}
+	}
+	out << std::endl;
+}
+
+const ast::tree& session::program() const
+{
+	return m_program;
+}
+
+const std::vector<ast::node_id>& session::statements() const
+{
+	return m_statements;
+}
+
+}
@@ -0,0 +1,263 @@
+#include <atomic>
+#include <cstdint>
+#include "scan.hpp"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SCAN_X86
+#define SCAN_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace scan
+{
+
+//! CHARACTER CLASSES
+
+#ifdef SCAN_X86
+/// Which bytes of v are in [lo, hi].
+inline __m128i in_range(__m128i v, char lo, char hi)
+{
+	__m128i offset = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+	return _mm_cmpeq_epi8(_mm_subs_epu8(offset, _mm_set1_epi8(hi - lo)), _mm_setzero_si128());
+}
+
+SCAN_AVX2 inline __m256i in_range(__m256i v, char lo, char hi)
+{
+	__m256i offset = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+	return _mm256_cmpeq_epi8(_mm256_subs_epu8(offset, _mm256_set1_epi8(hi - lo)), _mm256_setzero_si256());
+}
+#endif
+
+/**
+ * @brief Each character class has a scalar test, and SSE2 / AVX2 tests
+ * masking which bytes of a vector are in the class.
+ * 
+ */
+struct blank_class
+{
+	static bool scalar(unsigned char c)
+	{
+		return c == ' ' || (c >= '\t' && c <= '\r' && c != '\n');
+	}
+#ifdef SCAN_X86
+	static __m128i sse2(__m128i v)
+	{
+		__m128i controls = _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), in_range(v, '\t', '\r'));
+		return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), controls);
+	}
+	SCAN_AVX2 static __m256i avx2(__m256i v)
+	{
+		__m256i controls = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), in_range(v, '\t', '\r'));
+		return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), controls);
+	}
+#endif
+};
+
+struct digit_class
+{
+	static bool scalar(unsigned char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+#ifdef SCAN_X86
+	static __m128i sse2(__m128i v)
+	{
+		return in_range(v, '0', '9');
+	}
+	SCAN_AVX2 static __m256i avx2(__m256i v)
+	{
+		return in_range(v, '0', '9');
+	}
+#endif
+};
+
+struct alnum_class
+{
+	static bool scalar(unsigned char c)
+	{
+		// Setting 0x20 lowercases letters, without moving anything else into a-z.
+		return digit_class::scalar(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z');
+	}
+#ifdef SCAN_X86
+	static __m128i sse2(__m128i v)
+	{
+		__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+		return _mm_or_si128(digit_class::sse2(v), in_range(lower, 'a', 'z'));
+	}
+	SCAN_AVX2 static __m256i avx2(__m256i v)
+	{
+		__m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+		return _mm256_or_si256(digit_class::avx2(v), in_range(lower, 'a', 'z'));
+	}
+#endif
+};
+
+/// Everything but the characters that end a line: \n, \0, and optionally \r.
+template <bool StopAtCr>
+struct line_class
+{
+	static bool scalar(unsigned char c)
+	{
+		return c != '\n' && c != '\0' && !(StopAtCr && c == '\r');
+	}
+#ifdef SCAN_X86
+	static __m128i sse2(__m128i v)
+	{
+		__m128i ends = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+		if (StopAtCr)
+		{
+			ends = _mm_or_si128(ends, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+		}
+		return _mm_xor_si128(ends, _mm_set1_epi8(-1));
+	}
+	SCAN_AVX2 static __m256i avx2(__m256i v)
+	{
+		__m256i ends = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+		if (StopAtCr)
+		{
+			ends = _mm256_or_si256(ends, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+		}
+		return _mm256_xor_si256(ends, _mm256_set1_epi8(-1));
+	}
+#endif
+};
+
+//! KERNELS
+
+/// Get the first position at or after pos not in the class, one byte at a time.
+template <typename Class>
+size_t skip_scalar(std::string_view code, size_t pos)
+{
+	while (pos < code.size() && Class::scalar(code[pos]))
+	{
+		++pos;
+	}
+	return pos;
+}
+
+#ifdef SCAN_X86
+/// Get the first position at or after pos not in the class, 16 bytes at a time.
+template <typename Class>
+size_t skip_sse2(std::string_view code, size_t pos)
+{
+	for (; pos + 16 <= code.size(); pos += 16)
+	{
+		__m128i v	  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(code.data() + pos));
+		uint32_t outside = ~_mm_movemask_epi8(Class::sse2(v)) & 0xFFFF;
+		if (outside != 0)
+		{
+			return pos + __builtin_ctz(outside);
+		}
+	}
+	return skip_scalar<Class>(code, pos);
+}
+
+/// Get the first position at or after pos not in the class, 32 bytes at a time.
+template <typename Class>
+SCAN_AVX2 size_t skip_avx2(std::string_view code, size_t pos)
+{
+	for (; pos + 32 <= code.size(); pos += 32)
+	{
+		__m256i v		 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(code.data() + pos));
+		uint32_t outside = ~static_cast<uint32_t>(_mm256_movemask_epi8(Class::avx2(v)));
+		if (outside != 0)
+		{
+			return pos + __builtin_ctz(outside);
+		}
+	}
+	return skip_sse2<Class>(code, pos);
+}
+#endif
+
+/**
+ * @brief A full set of kernels, for one implementation.
+ * 
+ */
+struct kernels
+{
+	size_t (*skip_blank)(std::string_view, size_t);
+	size_t (*skip_alnum)(std::string_view, size_t);
+	size_t (*skip_digits)(std::string_view, size_t);
+	size_t (*line_end)(std::string_view, size_t);
+	size_t (*line_end_cr)(std::string_view, size_t);
+};
+
+/// Every implementation, indexed by level.
+static const kernels implementations[] = {
+	{ skip_scalar<blank_class>,
+	  skip_scalar<alnum_class>,
+	  skip_scalar<digit_class>,
+	  skip_scalar<line_class<false>>,
+	  skip_scalar<line_class<true>> },
+#ifdef SCAN_X86
+	{ skip_sse2<blank_class>,
+	  skip_sse2<alnum_class>,
+	  skip_sse2<digit_class>,
+	  skip_sse2<line_class<false>>,
+	  skip_sse2<line_class<true>> },
+	{ skip_avx2<blank_class>,
+	  skip_avx2<alnum_class>,
+	  skip_avx2<digit_class>,
+	  skip_avx2<line_class<false>>,
+	  skip_avx2<line_class<true>> },
+#endif
+};
+
+level best()
+{
+#ifdef SCAN_X86
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? level::avx2 : level::sse2;
+#else
+	return level::scalar;
+#endif
+}
+
+/// The implementation in use. Any thread may switch it while others are scanning.
+static std::atomic<level> active{ best() };
+
+void use(level l)
+{
+	active.store(l <= best() ? l : best(), std::memory_order_relaxed);
+}
+
+level current()
+{
+	return active.load(std::memory_order_relaxed);
+}
+
+const char* name(level l)
+{
+	switch (l)
+	{
+	case level::sse2:
+		return "sse2";
+	case level::avx2:
+		return "avx2";
+	default:
+		return "scalar";
+	}
+}
+
+size_t skip_blank(std::string_view code, size_t pos)
+{
+	return implementations[static_cast<int>(current())].skip_blank(code, pos);
+}
+
+size_t skip_alnum(std::string_view code, size_t pos)
+{
+	return implementations[static_cast<int>(current())].skip_alnum(code, pos);
+}
+
+size_t skip_digits(std::string_view code, size_t pos)
+{
+	return implementations[static_cast<int>(current())].skip_digits(code, pos);
+}
+
+size_t find_line_end(std::string_view code, size_t pos, bool stop_at_cr)
+{
+	const kernels& k = implementations[static_cast<int>(current())];
+	return stop_at_cr ? k.line_end_cr(code, pos) : k.line_end(code, pos);
+}
+
+}
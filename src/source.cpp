@@ -0,0 +1,114 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include "source.hpp"
+
+source::source(const std::string& path)
+	: m_data(nullptr), m_size(0), m_open(false)
+{
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return;
+	}
+	m_open = true;
+
+	struct stat st;
+	if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+	{
+		void* mapped = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped != MAP_FAILED)
+		{
+			m_data = static_cast<const char*>(mapped);
+			m_size = st.st_size;
+			// We only ever read the file front to back.
+			::madvise(mapped, m_size, MADV_SEQUENTIAL);
+		}
+	}
+	::close(fd);
+
+	// Not a regular file, read it the old fashioned way.
+	if (m_data == nullptr)
+	{
+		std::ifstream file(path);
+		m_fallback = std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		m_size	   = m_fallback.size();
+	}
+}
+
+source::~source()
+{
+	if (m_data != nullptr)
+	{
+		::munmap(const_cast<char*>(m_data), m_size);
+	}
+}
+
+source::operator bool() const
+{
+	return m_open;
+}
+
+std::string_view source::view() const
+{
+	if (m_data == nullptr)
+	{
+		return m_fallback;
+	}
+	return std::string_view(m_data, m_size);
+}
+
+size_t source::size() const
+{
+	return m_size;
+}
+
+size_t source::chunk_end(size_t begin) const
+{
+	if (m_size - begin <= chunk_size)
+	{
+		return m_size;
+	}
+
+	size_t newline = view().find('\n', begin + chunk_size);
+	return newline == std::string_view::npos ? m_size : newline + 1;
+}
+
+void source::release(size_t begin, size_t end) const
+{
+	if (m_data == nullptr)
+	{
+		return;
+	}
+
+	// madvise only works on whole pages. Everything before begin is released too,
+	// so only the page straddling end has to be kept.
+	const size_t page = ::sysconf(_SC_PAGESIZE);
+	begin			  = begin / page * page;
+	end				  = end / page * page;
+	if (begin < end)
+	{
+		::madvise(const_cast<char*>(m_data) + begin, end - begin, MADV_DONTNEED);
+	}
+}
+
+std::pair<size_t, size_t> source::position(size_t offset) const
+{
+	if (m_lines.empty())
+	{
+		std::string_view code = view();
+		m_lines.push_back(0);
+		for (size_t newline = code.find('\n'); newline != std::string_view::npos; newline = code.find('\n', newline + 1))
+		{
+			m_lines.push_back(newline + 1);
+		}
+	}
+
+	// The last line starting at or before the offset.
+	auto line = std::upper_bound(m_lines.begin(), m_lines.end(), offset) - 1;
+	return { line - m_lines.begin() + 1, offset - *line + 1 };
+}
@@ -0,0 +1,135 @@
+#include "symbol.hpp"
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace symbol
+{
+
+std::atomic<std::string_view*> blocks[max_blocks];
+
+/// Text is split over this many independently locked shards, so that threads parsing at once rarely wait on each other.
+static constexpr size_t shard_count = 16;
+
+/// Text is copied into arenas of this size. Longer text gets an allocation of its own.
+static constexpr size_t arena_size = 1 << 16;
+
+/**
+ * @brief The symbols whose text hashes to one shard.
+ *
+ */
+struct shard
+{
+	std::mutex mutex;
+	/// Keyed by views of the arenas, so that looking text up doesn't copy it.
+	std::unordered_map<std::string_view, id> ids;
+	std::vector<std::unique_ptr<char[]>> arenas;
+	/// The unused end of the last arena.
+	char* free	= nullptr;
+	size_t left = 0;
+
+	size_t stored = 0;
+
+	/// Copy text into the shard's arenas.
+	std::string_view store(std::string_view text)
+	{
+		if (text.size() > arena_size / 4)
+		{
+			arenas.push_back(std::make_unique<char[]>(text.size()));
+			std::memcpy(arenas.back().get(), text.data(), text.size());
+			return std::string_view(arenas.back().get(), text.size());
+		}
+		if (text.size() > left)
+		{
+			arenas.push_back(std::make_unique<char[]>(arena_size));
+			free = arenas.back().get();
+			left = arena_size;
+		}
+		std::memcpy(free, text.data(), text.size());
+		std::string_view copy(free, text.size());
+		free += text.size();
+		left -= text.size();
+		return copy;
+	}
+};
+
+static shard shards[shard_count];
+
+/// The next id to hand out.
+static std::atomic<id> next{ 0 };
+
+static shard& shard_of(std::string_view text)
+{
+	size_t hash = std::hash<std::string_view>()(text);
+	return shards[(hash ^ (hash >> 29)) % shard_count];
+}
+
+/// The block the symbol goes in, which is added if it's the first symbol there.
+static std::string_view* block_of(id sym)
+{
+	size_t index = sym / block_size;
+	if (index >= max_blocks)
+	{
+		throw std::runtime_error("Too many symbols.");
+	}
+
+	std::string_view* block = blocks[index].load(std::memory_order_acquire);
+	if (block == nullptr)
+	{
+		// Whichever thread gets there first adds the block. Blocks are never freed.
+		std::string_view* added = new std::string_view[block_size];
+		if (blocks[index].compare_exchange_strong(block, added, std::memory_order_acq_rel))
+		{
+			block = added;
+		}
+		else
+		{
+			delete[] added;
+		}
+	}
+	return block;
+}
+
+id intern(std::string_view text)
+{
+	shard& s = shard_of(text);
+	std::lock_guard lock(s.mutex);
+	auto found = s.ids.find(text);
+	if (found != s.ids.end())
+	{
+		return found->second;
+	}
+
+	// The text's written under the shard's lock, so any thread that's given the id can read it.
+	id added			  = next.fetch_add(1, std::memory_order_relaxed);
+	std::string_view copy = s.store(text);
+	block_of(added)[added % block_size] = copy;
+	s.ids.emplace(copy, added);
+	s.stored += text.size();
+	return added;
+}
+
+id find(std::string_view text)
+{
+	shard& s = shard_of(text);
+	std::lock_guard lock(s.mutex);
+	auto found = s.ids.find(text);
+	return found == s.ids.end() ? none : found->second;
+}
+
+statistics stats()
+{
+	statistics total = {};
+	for (shard& s : shards)
+	{
+		std::lock_guard lock(s.mutex);
+		total.symbols += s.ids.size();
+		total.stored += s.stored;
+	}
+	return total;
+}
+
+}
@@ -0,0 +1,156 @@
+#include "value.hpp"
+#include <charconv>
+
+namespace interpreter
+{
+
+/// Whether the text is exactly how an int64_t would print.
+bool is_integer(std::string_view text)
+{
+	if (text.empty() || text.size() > 18 || (text[0] == '0' && text.size() > 1))
+	{
+		return false;
+	}
+	for (char c : text)
+	{
+		if (c < '0' || c > '9')
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+variable::variable()
+	: m_bytes{}, m_length(0), m_storage(storage::empty), m_type(ast::kind::error)
+{
+}
+
+variable::variable(ast::kind type, std::string_view text)
+	: m_bytes{}, m_length(0), m_type(type)
+{
+	if (type == ast::kind::number && is_integer(text))
+	{
+		int64_t value = 0;
+		std::from_chars(text.data(), text.data() + text.size(), value);
+		set(value);
+		m_storage = storage::integer;
+	}
+	else if (text.size() <= inline_size)
+	{
+		std::memcpy(m_bytes, text.data(), text.size());
+		m_length  = text.size();
+		m_storage = storage::inline_text;
+	}
+	else
+	{
+		set_interned(symbol::intern(text));
+	}
+}
+
+variable::variable(const ast::tree& code, ast::node_id node)
+	: variable()
+{
+	symbol::id sym = code.symbol(node);
+	if (sym == symbol::none || code.text(node).size() <= inline_size)
+	{
+		*this = variable(code.type(node), code.text(node));
+		return;
+	}
+	m_type = code.type(node);
+	set_interned(sym);
+}
+
+void variable::set_interned(symbol::id sym)
+{
+	set(sym);
+	m_storage = storage::interned_text;
+}
+
+variable variable::integer(int64_t value)
+{
+	variable ret;
+	ret.set(value);
+	ret.m_storage = storage::integer;
+	ret.m_type	  = ast::kind::number;
+	return ret;
+}
+
+variable variable::real(double value)
+{
+	variable ret;
+	ret.set(value);
+	ret.m_storage = storage::real;
+	ret.m_type	  = ast::kind::number;
+	return ret;
+}
+
+const std::string& variable::type() const
+{
+	static const std::string none;
+	return m_storage == storage::empty ? none : ast::name(m_type);
+}
+
+ast::kind variable::kind() const
+{
+	return m_type;
+}
+
+bool variable::empty() const
+{
+	return m_storage == storage::empty;
+}
+
+std::string variable::value() const
+{
+	char number[32];
+	switch (m_storage)
+	{
+	case storage::integer:
+		return std::string(number, std::to_chars(number, number + sizeof(number), get<int64_t>()).ptr);
+	case storage::real:
+		return std::string(number, std::to_chars(number, number + sizeof(number), get<double>()).ptr);
+	default:
+		return std::string(text());
+	}
+}
+
+std::string_view variable::text() const
+{
+	switch (m_storage)
+	{
+	case storage::inline_text:
+		return std::string_view(m_bytes, m_length);
+	case storage::interned_text:
+		return symbol::text(get<symbol::id>());
+	default:
+		return "";
+	}
+}
+
+bool variable::operator==(const variable& other) const
+{
+	if (m_storage != other.m_storage || (m_storage != storage::empty && m_type != other.m_type))
+	{
+		return false;
+	}
+	switch (m_storage)
+	{
+	case storage::integer:
+		return get<int64_t>() == other.get<int64_t>();
+	case storage::real:
+		return get<double>() == other.get<double>();
+	case storage::interned_text:
+		// Text is only interned once.
+		return get<symbol::id>() == other.get<symbol::id>();
+	default:
+		return text() == other.text();
+	}
+}
+
+bool variable::operator!=(const variable& other) const
+{
+	return !(*this == other);
+}
+
+}
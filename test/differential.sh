@@ -0,0 +1,40 @@
+#!/bin/sh
+# Runs each program on every path through the interpreter, and checks that each one ends
+# with the same variable trace as walking the tree does, in the same order.
+#
+# usage: differential.sh program.sl...
+# The programs have to stay within what the legacy parser accepts, so no nested arithmetic.
+
+SLANG=${SLANG:-../build/slang}
+
+# Print the ending variable trace, or nothing if the program failed.
+trace() {
+	"$SLANG" "$@" -vvv 2>&1 | sed -n '/^Ending variable trace:/,$p'
+}
+
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+
+failed=0
+for program in "$@"; do
+	expected=$(trace "$program")
+	if [ -z "$expected" ]; then
+		echo "FAIL $program: the tree-walker didn't finish"
+		failed=1
+		continue
+	fi
+	for mode in "--bytecode" "--jit" "-O 1" "-O 1 --bytecode" "-O 1 --jit" "--legacy-parser" "--hash-cons"; do
+		# The mode is split into its arguments on purpose.
+		actual=$(trace "$program" $mode)
+		if [ "$actual" = "$expected" ]; then
+			echo "ok   $program $mode"
+		else
+			echo "FAIL $program $mode"
+			printf '%s\n' "$expected" > "$scratch/expected"
+			printf '%s\n' "$actual" > "$scratch/actual"
+			diff "$scratch/expected" "$scratch/actual"
+			failed=1
+		fi
+	done
+done
+exit $failed